@@ -19,6 +19,8 @@
 #include <Python.h>
 #include "structmember.h"
 
+#include <cerrno>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
@@ -27,8 +29,15 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <utility>
 
+#ifndef __MINGW32__
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
 #include <fnx.hpp>
 
 namespace {
@@ -57,16 +66,96 @@ inline void Py_VarXINCREF(Args &&...args) {
     (xincref(args), ...);
 }
 
+// Native objects are allocated by Python, so their members are constructed in place
+template <typename T>
+T *Py_NativeAlloc(PyTypeObject *type) {
+    auto *self = reinterpret_cast<T *>(type->tp_alloc(type, 0));
+    if (self) {
+        std::construct_at(&self->ptr);
+        std::construct_at(&self->mtx);
+    }
+    return self;
+}
+
+template <typename T>
+PyObject *Py_NativeNew(PyTypeObject *type, [[maybe_unused]] PyObject *args, [[maybe_unused]] PyObject *kwds) {
+    return _PyObject_CAST(Py_NativeAlloc<T>(type));
+}
+
+template <typename T>
+void Py_NativeFree(T *self) {
+    std::destroy_at(&self->mtx);
+    std::destroy_at(&self->ptr);
+    Py_TYPE(self)->tp_free(self);
+}
+
+// Runs a native call with the GIL released, serialized against other users of the same object
+// The GIL is dropped before locking, since the current owner might need it to call back into Python
+template <typename T, typename F>
+auto Py_AllowThreads(T *self, F &&func) {
+    struct Release {
+        PyThreadState *state = PyEval_SaveThread();
+        ~Release() {
+            PyEval_RestoreThread(this->state);
+        }
+    } release;
+
+    std::scoped_lock lk(self->mtx);
+    return func();
+}
+
+// Locks an object while keeping the GIL, to build Python objects from its state
+template <typename T>
+class PyObjectLock {
+    public:
+        PyObjectLock(T *self): mtx(self->mtx) {
+            if (!this->mtx.try_lock()) {
+                Py_BEGIN_ALLOW_THREADS
+                this->mtx.lock();
+                Py_END_ALLOW_THREADS
+            }
+        }
+
+        ~PyObjectLock() {
+            this->mtx.unlock();
+        }
+
+    private:
+        std::mutex &mtx;
+};
+
+// Reads may happen on any thread with the GIL released
+class PyGilGuard {
+    public:
+        PyGilGuard(): state(PyGILState_Ensure()) { }
+
+        ~PyGilGuard() {
+            PyGILState_Release(this->state);
+        }
+
+    private:
+        PyGILState_STATE state;
+};
+
 class IoFile final: public fnx::io::FileBase {
     public:
         IoFile(PyObject *object, std::size_t size) {
+            PyGilGuard gil;
             Py_XSETREF(this->object, Py_XNewRef(object));
             this->fsize = size;
+#ifndef __MINGW32__
+            this->desc = IoFile::open_descriptor(object);
+#endif
         }
 
-        IoFile(const IoFile &other): IoFile(other.object, other.fsize) { }
+        IoFile(const IoFile &other): desc(other.desc) {
+            PyGilGuard gil;
+            Py_XSETREF(this->object, Py_XNewRef(other.object));
+            this->fsize = other.fsize;
+        }
 
         virtual ~IoFile() override {
+            PyGilGuard gil;
             Py_CLEAR(this->object);
         }
 
@@ -79,32 +168,10 @@ class IoFile final: public fnx::io::FileBase {
         }
 
         virtual std::size_t read(void *dest, std::uint64_t size) override {
-            auto *obj = PyObject_New(PyByteArrayObject, &PyByteArray_Type);
-            FNX_SCOPEGUARD([&obj] { obj->ob_bytes = nullptr; Py_VarXDECREF(obj); });
-            if (!obj)
-                return 0;
-
-            obj->ob_bytes   = static_cast<char *>(dest);
-            obj->ob_start   = obj->ob_bytes;
-            obj->ob_alloc   = size;
-            obj->ob_exports = 0;
-            Py_SET_SIZE(obj, size);
-
-            {
-                auto *res = PyObject_CallMethod(this->object, "seek", "LI", this->pos, fnx::io::Whence::Set);
-                FNX_SCOPEGUARD([&res] { Py_VarXDECREF(res); });
-                if (!res)
-                    return 0;
-            }
-
-            {
-                auto *res = PyObject_CallMethod(this->object, "readinto", "O", _PyObject_CAST(obj));
-                FNX_SCOPEGUARD([&res] { Py_VarXDECREF(res); });
-                if (!res || res == Py_None)
-                    return 0;
-
-                return PyLong_AsSize_t(res);
-            }
+            // Consecutive reads continue where the previous one stopped, like for the other files
+            auto read = this->desc ? this->read_descriptor(dest, size) : this->read_object(dest, size);
+            this->pos += read;
+            return read;
         }
 
         virtual std::size_t write(const void *data, std::uint64_t size) override {
@@ -112,7 +179,110 @@ class IoFile final: public fnx::io::FileBase {
         }
 
     private:
+        struct Descriptor {
+            int fd;
+
+            ~Descriptor() {
+#ifndef __MINGW32__
+                close(this->fd);
+#endif
+            }
+        };
+
         PyObject *object = nullptr;
+        std::shared_ptr<const Descriptor> desc;
+
+#ifndef __MINGW32__
+        // Raw and buffered readers over a regular file expose its content through their descriptor,
+        // which is duplicated so that it stays valid if the Python object gets closed
+        static std::shared_ptr<const Descriptor> open_descriptor(PyObject *object) {
+            auto *io = PyImport_ImportModule("io");
+            FNX_SCOPEGUARD([&io] { Py_VarXDECREF(io); });
+            if (!io)
+                return PyErr_Clear(), nullptr;
+
+            bool is_file = false;
+            for (auto *name: { "FileIO", "BufferedReader" }) {
+                auto *type = PyObject_GetAttrString(io, name);
+                FNX_SCOPEGUARD([&type] { Py_VarXDECREF(type); });
+                if (type && PyObject_IsInstance(object, type) == 1)
+                    is_file = true;
+            }
+            PyErr_Clear();
+            if (!is_file)
+                return nullptr;
+
+            auto *res = PyObject_CallMethod(object, "fileno", nullptr);
+            FNX_SCOPEGUARD([&res] { Py_VarXDECREF(res); });
+            auto fd = res ? PyLong_AsLong(res) : -1;
+            if (fd < 0)
+                return PyErr_Clear(), nullptr;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+                return nullptr;
+
+            auto dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (dup_fd < 0)
+                return nullptr;
+
+            return std::make_shared<const Descriptor>(dup_fd);
+        }
+#endif
+
+        std::size_t read_descriptor(void *dest, std::uint64_t size) {
+#ifndef __MINGW32__
+            std::size_t read = 0;
+            while (read < size) {
+                auto rc = pread(this->desc->fd, static_cast<std::uint8_t *>(dest) + read, size - read, this->pos + read);
+                if (rc < 0 && errno == EINTR)
+                    continue;
+                if (rc <= 0) {
+                    if (rc < 0)
+                        std::fprintf(stderr, "Failed to read at %#" PRIx64 ": %d (%s)\n",
+                            this->pos + read, errno, std::strerror(errno));
+                    break;
+                }
+                read += rc;
+            }
+            return read;
+#else
+            FNX_UNUSED(dest, size);
+            return 0;
+#endif
+        }
+
+        std::size_t read_object(void *dest, std::uint64_t size) {
+            PyGilGuard gil;
+            FNX_SCOPEGUARD([this] {
+                if (PyErr_Occurred())
+                    PyErr_WriteUnraisable(this->object);
+            });
+
+            auto *res = PyObject_CallMethod(this->object, "seek", "LI", this->pos, fnx::io::Whence::Set);
+            if (!res)
+                return 0;
+            Py_VarDECREF(res);
+
+            // Let the object fill the destination directly, and invalidate the view once done
+            auto *view = PyMemoryView_FromMemory(static_cast<char *>(dest), size, PyBUF_WRITE);
+            if (!view)
+                return 0;
+            FNX_SCOPEGUARD([&view] {
+                Py_VarXDECREF(PyObject_CallMethod(view, "release", nullptr));
+                Py_VarDECREF(view);
+            });
+
+            res = PyObject_CallMethod(this->object, "readinto", "O", view);
+            FNX_SCOPEGUARD([&res] { Py_VarXDECREF(res); });
+            if (!res || res == Py_None)
+                return 0;
+
+            auto read = PyLong_AsSize_t(res);
+            if (read == static_cast<std::size_t>(-1) && PyErr_Occurred())
+                return 0;
+            return std::min(read, static_cast<std::size_t>(size));
+        }
 };
 
 } // namespace
@@ -120,6 +290,7 @@ class IoFile final: public fnx::io::FileBase {
 struct PyFileBase {
     PyObject_HEAD
     std::unique_ptr<fnx::io::FileBase> ptr;
+    std::mutex mtx;
 };
 
 static int PyFileBase_init(PyFileBase *self, PyObject *args, PyObject *kwds) {
@@ -131,15 +302,18 @@ static int PyFileBase_init(PyFileBase *self, PyObject *args, PyObject *kwds) {
         auto *path = PyUnicode_AsUTF8(obj1),
             *mode = PyUnicode_AsUTF8(obj2);
 
-        auto f = std::make_unique<fnx::io::File>(path, mode);
+        auto f = Py_AllowThreads(self, [path, mode] {
+            auto f = std::make_unique<fnx::io::File>(path, mode);
+            if (f->good())
+                f->update_size();
+            return f;
+        });
 
         if (!f->good()) {
             PyErr_Format(PyExc_RuntimeError, "%s stream is not good", path);
             return 1;
         }
 
-        f->update_size();
-
         self->ptr = std::move(f);
     } else if (PyLong_Check(obj2)) {
         auto size = PyLong_AsSize_t(obj2);
@@ -152,8 +326,7 @@ static int PyFileBase_init(PyFileBase *self, PyObject *args, PyObject *kwds) {
 }
 
 static void PyFileBase_dealloc(PyFileBase *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyFileBase_parent_offset(PyFileBase *self, [[maybe_unused]] PyObject *args) {
@@ -161,12 +334,11 @@ static PyObject *PyFileBase_parent_offset(PyFileBase *self, [[maybe_unused]] PyO
 }
 
 static PyObject *PyFileBase_clone(PyFileBase *self, [[maybe_unused]] PyObject *args) {
-    auto *file = PyObject_New(PyFileBase, Py_TYPE(self));
+    auto *file = Py_NativeAlloc<PyFileBase>(Py_TYPE(self));
     if (!file)
         return nullptr;
 
-    file->ptr.release();
-    file->ptr = self->ptr->clone();
+    file->ptr = Py_AllowThreads(self, [self] { return self->ptr->clone(); });
     return _PyObject_CAST(file);
 }
 
@@ -180,12 +352,12 @@ static PyObject *PyFileBase_seek(PyFileBase *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, "kI", &where, &whence))
         return nullptr;
 
-    self->ptr->seek(where, whence);
+    Py_AllowThreads(self, [self, where, whence] { self->ptr->seek(where, whence); });
     Py_RETURN_NONE;
 }
 
 static PyObject *PyFileBase_tell(PyFileBase *self, [[maybe_unused]] PyObject *args) {
-    return PyLong_FromUnsignedLong(self->ptr->tell());
+    return PyLong_FromUnsignedLong(Py_AllowThreads(self, [self] { return self->ptr->tell(); }));
 }
 
 static PyObject *PyFileBase_read(PyFileBase *self, PyObject *args) {
@@ -194,9 +366,45 @@ static PyObject *PyFileBase_read(PyFileBase *self, PyObject *args) {
         return nullptr;
 
     FNX_SCOPEGUARD([&buffer] { PyBuffer_Release(&buffer); });
-    auto size = std::clamp(static_cast<std::uint64_t>(buffer.len), static_cast<std::uint64_t>(0),
-        self->ptr->size() - self->ptr->tell());
-    return PyLong_FromUnsignedLong(self->ptr->read(buffer.buf, size));
+    return PyLong_FromUnsignedLong(Py_AllowThreads(self, [self, &buffer] {
+        auto size = std::clamp(static_cast<std::uint64_t>(buffer.len), static_cast<std::uint64_t>(0),
+            self->ptr->size() - self->ptr->tell());
+        return self->ptr->read(buffer.buf, size);
+    }));
+}
+
+static PyObject *PyFileBase_readinto(PyFileBase *self, PyObject *args) {
+    Py_buffer buffer;
+    if (!PyArg_ParseTuple(args, "w*", &buffer))
+        return nullptr;
+
+    FNX_SCOPEGUARD([&buffer] { PyBuffer_Release(&buffer); });
+    return PyLong_FromSize_t(Py_AllowThreads(self, [self, &buffer] {
+        auto size = std::min(static_cast<std::uint64_t>(buffer.len),
+            self->ptr->size() - std::min(static_cast<std::uint64_t>(self->ptr->tell()), self->ptr->size()));
+        return self->ptr->read(buffer.buf, size);
+    }));
+}
+
+static PyObject *PyFileBase_readall(PyFileBase *self, [[maybe_unused]] PyObject *args) {
+    // The bytearray is allocated uninitialized and filled in place
+    auto remaining = Py_AllowThreads(self, [self] {
+        return self->ptr->size() - std::min(static_cast<std::uint64_t>(self->ptr->tell()), self->ptr->size());
+    });
+
+    auto *array = PyByteArray_FromStringAndSize(nullptr, remaining);
+    if (!array)
+        return nullptr;
+
+    auto read = Py_AllowThreads(self, [self, array, remaining] {
+        auto size = std::min(remaining,
+            self->ptr->size() - std::min(static_cast<std::uint64_t>(self->ptr->tell()), self->ptr->size()));
+        return self->ptr->read(PyByteArray_AS_STRING(array), size);
+    });
+
+    if (read != remaining && PyByteArray_Resize(array, read) < 0)
+        return Py_VarDECREF(array), nullptr;
+    return array;
 }
 
 static PyObject *PyFileBase_write(PyFileBase *self, PyObject *args) {
@@ -205,7 +413,9 @@ static PyObject *PyFileBase_write(PyFileBase *self, PyObject *args) {
         return nullptr;
 
     FNX_SCOPEGUARD([&buffer] { PyBuffer_Release(&buffer); });
-    return PyLong_FromUnsignedLong(self->ptr->write(buffer.buf, buffer.len));
+    return PyLong_FromUnsignedLong(Py_AllowThreads(self, [self, &buffer] {
+        return self->ptr->write(buffer.buf, buffer.len);
+    }));
 }
 
 static std::array PyFileBase_methods = {
@@ -233,6 +443,18 @@ static std::array PyFileBase_methods = {
         .ml_flags = METH_VARARGS,
         .ml_doc   = "Reads file data"
     },
+    PyMethodDef{
+        .ml_name  = "readinto",
+        .ml_meth  = _PyCFunction_CAST(PyFileBase_readinto),
+        .ml_flags = METH_VARARGS,
+        .ml_doc   = "Reads file data into a writable buffer"
+    },
+    PyMethodDef{
+        .ml_name  = "readall",
+        .ml_meth  = _PyCFunction_CAST(PyFileBase_readall),
+        .ml_flags = METH_NOARGS,
+        .ml_doc   = "Reads the rest of the file into a bytearray"
+    },
     PyMethodDef{
         .ml_name  = "write",
         .ml_meth  = _PyCFunction_CAST(PyFileBase_write),
@@ -263,7 +485,7 @@ static PyTypeObject PyFileBaseType = {
     .tp_doc       = "File object",
     .tp_methods   = PyFileBase_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyFileBase_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyFileBase>,
 };
 
 struct PyPfsEntry {
@@ -313,6 +535,7 @@ static PyTypeObject PyPfsEntryType = {
 struct PyPfs {
     PyObject_HEAD
     std::unique_ptr<fnx::hac::Pfs> ptr;
+    std::mutex mtx;
 };
 
 static int PyPfs_init(PyPfs *self, PyObject *args, PyObject *kwds) {
@@ -320,24 +543,24 @@ static int PyPfs_init(PyPfs *self, PyObject *args, PyObject *kwds) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return 1;
 
-    self->ptr = std::make_unique<fnx::hac::Pfs>(base->ptr->clone());
+    auto file = Py_AllowThreads(base, [base] { return base->ptr->clone(); });
+    self->ptr = std::make_unique<fnx::hac::Pfs>(std::move(file));
     return 0;
 }
 
 static void PyPfs_dealloc(PyPfs *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyPfs_is_valid(PyPfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->is_valid())
+    if (Py_AllowThreads(self, [self] { return self->ptr->is_valid(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyPfs_parse(PyPfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->parse())
+    if (Py_AllowThreads(self, [self] { return self->ptr->parse(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -348,6 +571,8 @@ static PyObject *PyPfs_get_entries(PyPfs *self, [[maybe_unused]] PyObject *args)
     if (!dict)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &entry: self->ptr->get_entries()) {
         auto *obj = PyObject_New(PyPfsEntry, &PyPfsEntryType);
         if (!obj)
@@ -375,12 +600,13 @@ static PyObject *PyPfs_open(PyPfs *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, "O", &entry))
         return nullptr;
 
-    auto *file = PyObject_New(PyFileBase, &PyFileBaseType);
+    auto *file = Py_NativeAlloc<PyFileBase>(&PyFileBaseType);
     if (!file)
         return nullptr;
 
-    file->ptr.release();
-    file->ptr = self->ptr->open({ entry->offset, entry->size });
+    file->ptr = Py_AllowThreads(self, [self, offset = entry->offset, size = entry->size] {
+        return self->ptr->open({ offset, size });
+    });
     return _PyObject_CAST(file);
 }
 
@@ -421,7 +647,7 @@ static PyTypeObject PyPfsType = {
     .tp_doc       = "Pfs object",
     .tp_methods   = PyPfs_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyPfs_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyPfs>,
 };
 
 struct PyHfsEntry {
@@ -471,6 +697,7 @@ static PyTypeObject PyHfsEntryType = {
 struct PyHfs {
     PyObject_HEAD
     std::unique_ptr<fnx::hac::Hfs> ptr;
+    std::mutex mtx;
 };
 
 static int PyHfs_init(PyHfs *self, PyObject *args, PyObject *kwds) {
@@ -478,24 +705,24 @@ static int PyHfs_init(PyHfs *self, PyObject *args, PyObject *kwds) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return 1;
 
-    self->ptr = std::make_unique<fnx::hac::Hfs>(base->ptr->clone());
+    auto file = Py_AllowThreads(base, [base] { return base->ptr->clone(); });
+    self->ptr = std::make_unique<fnx::hac::Hfs>(std::move(file));
     return 0;
 }
 
 static void PyHfs_dealloc(PyHfs *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyHfs_is_valid(PyHfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->is_valid())
+    if (Py_AllowThreads(self, [self] { return self->ptr->is_valid(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyHfs_parse(PyHfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->parse())
+    if (Py_AllowThreads(self, [self] { return self->ptr->parse(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -506,6 +733,8 @@ static PyObject *PyHfs_get_entries(PyHfs *self, [[maybe_unused]] PyObject *args)
     if (!dict)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &entry: self->ptr->get_entries()) {
         auto *obj = PyObject_New(PyHfsEntry, &PyHfsEntryType);
         if (!obj)
@@ -533,12 +762,13 @@ static PyObject *PyHfs_open(PyHfs *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, "O", &entry))
         return nullptr;
 
-    auto *file = PyObject_New(PyFileBase, &PyFileBaseType);
+    auto *file = Py_NativeAlloc<PyFileBase>(&PyFileBaseType);
     if (!file)
         return nullptr;
 
-    file->ptr.release();
-    file->ptr = self->ptr->open({ entry->offset, entry->size });
+    file->ptr = Py_AllowThreads(self, [self, offset = entry->offset, size = entry->size] {
+        return self->ptr->open({ offset, size });
+    });
     return _PyObject_CAST(file);
 }
 
@@ -579,7 +809,7 @@ static PyTypeObject PyHfsType = {
     .tp_doc       = "Hfs object",
     .tp_methods   = PyHfs_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyHfs_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyHfs>,
 };
 
 struct PyRomfsFileEntry {
@@ -716,6 +946,7 @@ static PyTypeObject PyRomfsDirEntryType = {
 struct PyRomfs {
     PyObject_HEAD
     std::unique_ptr<fnx::hac::RomFs> ptr;
+    std::mutex mtx;
 };
 
 static int PyRomfs_init(PyRomfs *self, PyObject *args, PyObject *kwds) {
@@ -723,24 +954,24 @@ static int PyRomfs_init(PyRomfs *self, PyObject *args, PyObject *kwds) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return 1;
 
-    self->ptr = std::make_unique<fnx::hac::RomFs>(base->ptr->clone());
+    auto file = Py_AllowThreads(base, [base] { return base->ptr->clone(); });
+    self->ptr = std::make_unique<fnx::hac::RomFs>(std::move(file));
     return 0;
 }
 
 static void PyRomfs_dealloc(PyRomfs *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyRomfs_is_valid(PyRomfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->is_valid())
+    if (Py_AllowThreads(self, [self] { return self->ptr->is_valid(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyRomfs_parse(PyRomfs *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->parse_full())
+    if (Py_AllowThreads(self, [self] { return self->ptr->parse_full(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -856,6 +1087,7 @@ static PyObject *PyRomfs_get_entries(PyRomfs *self, [[maybe_unused]] PyObject *a
     PyDict_SetItem(dir_dict, path, _PyObject_CAST(root_obj));
     Py_VarDECREF(path, root_obj);
 
+    PyObjectLock lk(self);
     auto &root_entry = self->ptr->get_root();
     walk(root_entry.get(), root_obj);
     FNX_SCOPEGUARD([&] { Py_VarDECREF(file_dict, dir_dict); });
@@ -867,7 +1099,7 @@ static PyObject *PyRomfs_open(PyRomfs *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, "O", &entry))
         return nullptr;
 
-    auto *file = PyObject_New(PyFileBase, &PyFileBaseType);
+    auto *file = Py_NativeAlloc<PyFileBase>(&PyFileBaseType);
     if (!file)
         return nullptr;
 
@@ -875,8 +1107,7 @@ static PyObject *PyRomfs_open(PyRomfs *self, PyObject *args) {
     meta.offset = entry->offset;
     meta.size   = entry->size;
 
-    file->ptr.release();
-    file->ptr = self->ptr->open(meta);
+    file->ptr = Py_AllowThreads(self, [self, &meta] { return self->ptr->open(meta); });
     return _PyObject_CAST(file);
 }
 
@@ -917,12 +1148,13 @@ static PyTypeObject PyRomfsType = {
     .tp_doc       = "Romfs object",
     .tp_methods   = PyRomfs_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyRomfs_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyRomfs>,
 };
 
 struct PyNca {
     PyObject_HEAD
     std::unique_ptr<fnx::hac::Nca> ptr;
+    std::mutex mtx;
 };
 
 static int PyNca_init(PyNca *self, PyObject *args, PyObject *kwds) {
@@ -930,51 +1162,57 @@ static int PyNca_init(PyNca *self, PyObject *args, PyObject *kwds) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return 1;
 
-    self->ptr = std::make_unique<fnx::hac::Nca>(base->ptr->clone());
+    auto file = Py_AllowThreads(base, [base] { return base->ptr->clone(); });
+    self->ptr = std::make_unique<fnx::hac::Nca>(std::move(file));
     return 0;
 }
 
 static void PyNca_dealloc(PyNca *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyNca_is_valid(PyNca *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->is_valid())
+    if (Py_AllowThreads(self, [self] { return self->ptr->is_valid(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyNca_parse(PyNca *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->parse())
+    if (Py_AllowThreads(self, [self] { return self->ptr->parse(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyNca_get_distribution_type(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return PyLong_FromUnsignedLong(static_cast<unsigned long>(self->ptr->get_distribution_type()));
 }
 
 static PyObject *PyNca_get_content_type(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return PyLong_FromUnsignedLong(static_cast<unsigned long>(self->ptr->get_content_type()));
 }
 
 static PyObject *PyNca_get_size(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return PyLong_FromUnsignedLong(self->ptr->get_size());
 }
 
 static PyObject *PyNca_get_title_id(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return PyLong_FromUnsignedLong(self->ptr->get_title_id());
 }
 
 static PyObject *PyNca_get_sdk_ver(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     auto &&[major, minor, micro, rev] = self->ptr->get_sdk_ver();
     return Py_BuildValue("(iiii)", major, minor, micro, rev);
 }
 
 static PyObject *PyNca_get_rights_id(PyNca *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return Py_BuildValue("y#", reinterpret_cast<const char *>(self->ptr->get_rights_id().data()), 0x10);
 }
 
@@ -983,23 +1221,23 @@ static PyObject *PyNca_get_sections(PyNca *self, [[maybe_unused]] PyObject *args
     if (!list)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &section: self->ptr->get_sections()) {
         if (section.get_type() == fnx::hac::Nca::SectionType::Pfs) {
-            auto *obj = PyObject_New(PyPfs, &PyPfsType);
+            auto *obj = Py_NativeAlloc<PyPfs>(&PyPfsType);
             if (!obj)
                 continue;
 
-            obj->ptr.release();
             obj->ptr = std::make_unique<fnx::hac::Pfs>(section.get_pfs());
 
             PyList_Append(list, _PyObject_CAST(obj));
             Py_VarDECREF(obj);
         } else {
-            auto *obj = PyObject_New(PyRomfs, &PyRomfsType);
+            auto *obj = Py_NativeAlloc<PyRomfs>(&PyRomfsType);
             if (!obj)
                 continue;
 
-            obj->ptr.release();
             obj->ptr = std::make_unique<fnx::hac::RomFs>(section.get_romfs());
 
             PyList_Append(list, _PyObject_CAST(obj));
@@ -1015,6 +1253,8 @@ static PyObject *PyNca_get_section_types(PyNca *self, [[maybe_unused]] PyObject
     if (!list)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &section: self->ptr->get_section_infos()) {
         auto t = (section.type == fnx::hac::Nca::SectionType::Pfs) ? fnx::hac::Format::Pfs : fnx::hac::Format::RomFs;
         auto *type = PyLong_FromLong(static_cast<long>(t));
@@ -1033,6 +1273,8 @@ static PyObject *PyNca_get_section_bounds(PyNca *self, [[maybe_unused]] PyObject
     if (!list)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &section: self->ptr->get_section_infos()) {
         auto *tuple = Py_BuildValue("(kk)", section.offset, section.size);
         if (!tuple)
@@ -1050,6 +1292,8 @@ static PyObject *PyNca_get_container_bounds(PyNca *self, [[maybe_unused]] PyObje
     if (!list)
         return nullptr;
 
+    PyObjectLock lk(self);
+
     for (auto &section: self->ptr->get_section_infos()) {
         auto *tuple = Py_BuildValue("(kk)", section.container_offset, section.container_size);
         if (!tuple)
@@ -1147,12 +1391,13 @@ static PyTypeObject PyNcaType = {
     .tp_doc       = "Nca object",
     .tp_methods   = PyNca_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyNca_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyNca>,
 };
 
 struct PyXci {
     PyObject_HEAD
     std::unique_ptr<fnx::hac::Xci> ptr;
+    std::mutex mtx;
 };
 
 static int PyXci_init(PyXci *self, PyObject *args, PyObject *kwds) {
@@ -1160,30 +1405,31 @@ static int PyXci_init(PyXci *self, PyObject *args, PyObject *kwds) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return 1;
 
-    self->ptr = std::make_unique<fnx::hac::Xci>(base->ptr->clone());
+    auto file = Py_AllowThreads(base, [base] { return base->ptr->clone(); });
+    self->ptr = std::make_unique<fnx::hac::Xci>(std::move(file));
     return 0;
 }
 
 static void PyXci_dealloc(PyXci *self) {
-    self->ptr.reset();
-    Py_TYPE(self)->tp_free(self);
+    Py_NativeFree(self);
 }
 
 static PyObject *PyXci_is_valid(PyXci *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->is_valid())
+    if (Py_AllowThreads(self, [self] { return self->ptr->is_valid(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyXci_parse(PyXci *self, [[maybe_unused]] PyObject *args) {
-    if (self->ptr->parse())
+    if (Py_AllowThreads(self, [self] { return self->ptr->parse(); }))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
 static PyObject *PyXci_get_cart_type(PyXci *self, [[maybe_unused]] PyObject *args) {
+    PyObjectLock lk(self);
     return PyLong_FromUnsignedLong(static_cast<unsigned long>(self->ptr->get_cart_type()));
 }
 
@@ -1192,8 +1438,9 @@ static PyObject *PyXci_get_partitions(PyXci *self, [[maybe_unused]] PyObject *ar
     if (!dict)
         return nullptr;
 
+    PyObjectLock lk(self);
     for (auto &part: self->ptr->get_partitions()) {
-        auto *obj = PyObject_New(PyHfs, &PyHfsType);
+        auto *obj = Py_NativeAlloc<PyHfs>(&PyHfsType);
         if (!obj)
             continue;
 
@@ -1204,7 +1451,6 @@ static PyObject *PyXci_get_partitions(PyXci *self, [[maybe_unused]] PyObject *ar
             continue;
         }
 
-        obj->ptr.release();
         obj->ptr = std::make_unique<fnx::hac::Hfs>(part.get_hfs());
 
         PyDict_SetItem(dict, name, _PyObject_CAST(obj));
@@ -1251,7 +1497,7 @@ static PyTypeObject PyXciType = {
     .tp_doc       = "Xci object",
     .tp_methods   = PyXci_methods.data(),
     .tp_init      = reinterpret_cast<initproc>(PyXci_init),
-    .tp_new       = PyType_GenericNew,
+    .tp_new       = Py_NativeNew<PyXci>,
 };
 
 static PyObject *fnxbinds_set_key(PyObject *self, PyObject *args) {
@@ -1296,7 +1542,8 @@ static PyObject *fnxbinds_match(PyObject *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, "O", &base))
         return nullptr;
 
-    return PyLong_FromLong(static_cast<long>(fnx::hac::match(base->ptr->read(0x400))));
+    auto format = Py_AllowThreads(base, [base] { return fnx::hac::match(base->ptr->read(0x400)); });
+    return PyLong_FromLong(static_cast<long>(format));
 }
 
 static std::array fnxbinds_methods = {
@@ -1381,6 +1628,11 @@ PyMODINIT_FUNC PyInit_fnxbinds() {
     if (!m)
         goto exit;
 
+#ifdef Py_GIL_DISABLED
+    // Native objects are guarded by their own lock, so the module is safe to use without the GIL
+    PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED);
+#endif
+
     PyModule_AddIntConstant(m, "FORMAT_PFS",   static_cast<long>(fnx::hac::Format::Pfs));
     PyModule_AddIntConstant(m, "FORMAT_HFS",   static_cast<long>(fnx::hac::Format::Hfs));
     PyModule_AddIntConstant(m, "FORMAT_ROMFS", static_cast<long>(fnx::hac::Format::RomFs));
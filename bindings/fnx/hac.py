@@ -51,13 +51,11 @@ class File(io.RawIOBase):
     def tell(self) -> int:
         return self.base.tell()
 
-    def readall(self):
-        b = bytes(self.size)
-        self.readinto(b)
-        return b
+    def readall(self) -> bytearray:
+        return self.base.readall()
 
-    def readinto(self, b: bytes) -> int:
-        return self.base.read(b)
+    def readinto(self, b: Union[bytearray, memoryview]) -> int:
+        return self.base.readinto(b)
 
     def write(self, b: bytes) -> int:
         return self.base.write(b)
@@ -36,6 +36,8 @@ class FileBase:
     def tell(self) -> int: ...
 
     def read(self, data: bytes) -> int: ...
+    def readinto(self, data: Union[bytearray, memoryview]) -> int: ...
+    def readall(self) -> bytearray: ...
     def write(self, data: bytes) -> int: ...
 
     def parent_offset(self) -> int: ...
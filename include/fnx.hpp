@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <fnx/buffer.hpp>
 #include <fnx/crypto.hpp>
 #include <fnx/hac.hpp>
 #include <fnx/io.hpp>
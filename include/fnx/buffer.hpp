@@ -0,0 +1,117 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of Fuse-Nx.
+//
+// Fuse-Nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Fuse-Nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Fuse-Nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace fnx::io {
+
+// Page-aligned memory borrowed from the buffer pool, and given back to it on destruction
+// The contents are left uninitialized
+class Buffer {
+    public:
+        using value_type = std::uint8_t;
+
+    public:
+        Buffer() = default;
+
+        Buffer(Buffer &&other): ptr(std::exchange(other.ptr, nullptr)),
+            bsize(std::exchange(other.bsize, 0)), cap(std::exchange(other.cap, 0)) { }
+
+        Buffer &operator =(Buffer &&other) {
+            std::swap(this->ptr,   other.ptr);
+            std::swap(this->bsize, other.bsize);
+            std::swap(this->cap,   other.cap);
+            return *this;
+        }
+
+        ~Buffer();
+
+        value_type *data() {
+            return this->ptr;
+        }
+
+        const value_type *data() const {
+            return this->ptr;
+        }
+
+        std::size_t size() const {
+            return this->bsize;
+        }
+
+        std::size_t capacity() const {
+            return this->cap;
+        }
+
+        bool empty() const {
+            return !this->bsize;
+        }
+
+        // Only shrinks or grows within the capacity
+        void resize(std::size_t size) {
+            this->bsize = std::min(size, this->cap);
+        }
+
+        value_type *begin() {
+            return this->ptr;
+        }
+
+        value_type *end() {
+            return this->ptr + this->bsize;
+        }
+
+    private:
+        friend class BufferPool;
+
+        Buffer(value_type *ptr, std::size_t size, std::size_t cap): ptr(ptr), bsize(size), cap(cap) { }
+
+    private:
+        value_type *ptr   = nullptr;
+        std::size_t bsize = 0, cap = 0;
+};
+
+// Process-wide pool of page-aligned buffers
+// Capacities are rounded up to a power of two of at least a page. Released buffers are cached in a free list
+// local to the releasing thread, so that steady-state acquisitions neither go through the allocator
+// nor fault pages in again
+class BufferPool {
+    public:
+        constexpr static std::size_t page_size      = 0x1000;
+        constexpr static std::size_t huge_page_size = 0x200000;
+
+    public:
+        static Buffer acquire(std::size_t size);
+
+        // Backs buffers of at least a huge page with transparent huge pages, where supported
+        static void set_use_hugepages(bool use);
+
+    private:
+        friend class Buffer;
+
+        static void release(Buffer::value_type *ptr, std::size_t cap);
+};
+
+inline Buffer::~Buffer() {
+    if (this->ptr)
+        BufferPool::release(this->ptr, this->cap);
+}
+
+} // namespace fnx::io
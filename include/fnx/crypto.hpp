@@ -18,6 +18,7 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <utility>
@@ -27,6 +28,7 @@
 #else
 #   define MBEDTLS_ALLOW_PRIVATE_ACCESS
 #   include <mbedtls/cipher.h>
+#   include <mbedtls/sha256.h>
 #endif
 
 #include <fnx/keyset.hpp>
@@ -303,6 +305,68 @@ class AesXtsNintendo final: public CipherBase<MBEDTLS_CIPHER_AES_128_XTS, AesXts
         std::uint64_t sector;
 };
 
+// Incremental SHA-256, using the hardware accelerated implementation of the backend where available
+class Sha256 {
+    public:
+        Sha256() {
+#ifdef USE_GCRYPT
+            gcry_md_open(&this->handle, GCRY_MD_SHA256, 0);
+#else
+            mbedtls_sha256_init(&this->ctx);
+            mbedtls_sha256_starts(&this->ctx, 0);
+#endif
+        }
+
+        Sha256(const Sha256 &) = delete;
+        Sha256 &operator =(const Sha256 &) = delete;
+
+        ~Sha256() {
+#ifdef USE_GCRYPT
+            gcry_md_close(this->handle);
+#else
+            mbedtls_sha256_free(&this->ctx);
+#endif
+        }
+
+        void update(const void *data, std::size_t size) {
+#ifdef USE_GCRYPT
+            gcry_md_write(this->handle, data, size);
+#else
+            mbedtls_sha256_update(&this->ctx, static_cast<const std::uint8_t *>(data), size);
+#endif
+        }
+
+        Sha256Hash finalize() {
+            Sha256Hash hash;
+#ifdef USE_GCRYPT
+            std::copy_n(gcry_md_read(this->handle, GCRY_MD_SHA256), hash.size(), hash.begin());
+#else
+            mbedtls_sha256_finish(&this->ctx, hash.data());
+#endif
+            return hash;
+        }
+
+    private:
+#ifdef USE_GCRYPT
+        gcry_md_hd_t handle;
+#else
+        mbedtls_sha256_context ctx;
+#endif
+};
+
+// Incremental CRC-32 (IEEE 802.3, as used by zlib)
+class Crc32 {
+    public:
+        void update(const void *data, std::size_t size);
+
+        std::uint32_t finalize() const {
+            return ~this->crc;
+        }
+
+    private:
+        std::uint32_t crc = ~0u;
+};
+
 AesKey gen_aes_kek(const AesKey &src, const AesKey &mkey, const AesKey &kek_seed, const AesKey &key_seed);
 
 } // namespace fnx::crypt
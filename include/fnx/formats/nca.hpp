@@ -289,7 +289,7 @@ class Nca final: public FormatBase {
         static SectionInfo make_section_info(const FsEntry &entry, const FsHeader &header);
 
         bool decrypt_titlekey();
-        void decrypt_keyarea();
+        bool decrypt_keyarea();
 
         static void decrypt_header(Header &header);
 
@@ -112,6 +112,14 @@ class RomFs final: public FormatBase {
             return this->file_entries.size();
         }
 
+        // Memory used by the tables and the parsed entries
+        std::size_t get_meta_size() const {
+            return (this->dir_hash_tbl.size() + this->file_hash_tbl.size()) * sizeof(std::uint32_t) +
+                this->dir_meta_tbl.size() + this->file_meta_tbl.size() +
+                this->dir_entries.capacity()  * (sizeof(void *) + sizeof(DirEntry)) +
+                this->file_entries.capacity() * (sizeof(void *) + sizeof(FileEntry));
+        }
+
         const std::vector<std::unique_ptr<DirEntry>> &get_dir_entries() const {
             return this->dir_entries;
         }
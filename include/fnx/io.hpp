@@ -17,10 +17,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <memory>
-#include <mutex>
+#include <optional>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -36,6 +38,14 @@ enum class Whence {
     End,
 };
 
+class File;
+
+// Range of a host file holding data as-is (ie. without any transformation such as decryption)
+struct Extent {
+    const File   *file;
+    std::uint64_t offset, size;
+};
+
 class FileBase {
     public:
         virtual ~FileBase() = default;
@@ -43,6 +53,13 @@ class FileBase {
         virtual std::size_t parent_offset() const = 0;
         virtual std::unique_ptr<FileBase> clone() const = 0;
 
+        // Maps a range of this file to the host file backing it, if the data is stored in plaintext
+        // The returned extent may be shorter than requested when the range goes past the end of the file
+        virtual std::optional<Extent> get_extent(std::uint64_t offset, std::uint64_t size) const {
+            FNX_UNUSED(offset, size);
+            return std::nullopt;
+        }
+
         std::uint64_t size() const {
             return this->fsize;
         }
@@ -71,6 +88,18 @@ class FileBase {
 
         virtual std::size_t read(void *dest, std::uint64_t size) = 0;
 
+        // Reads data with the outermost transformation (eg. encryption) still applied,
+        // so that decode can undo it separately, possibly on another thread
+        virtual std::size_t read_encoded(void *dest, std::uint64_t size) {
+            return this->read(dest, size);
+        }
+
+        // Undoes the transformation on data obtained from read_encoded at the given offset
+        // This does not touch the state of the file, and is safe to call concurrently
+        virtual void decode(void *data, std::uint64_t size, std::uint64_t offset) const {
+            FNX_UNUSED(data, size, offset);
+        }
+
         std::vector<std::uint8_t> read(std::uint64_t size) {
             std::vector<std::uint8_t> data(size);
             this->read(data.data(), size);
@@ -130,10 +159,19 @@ class File final: public FileBase {
             return std::make_unique<File>(*this);
         }
 
+        virtual std::optional<Extent> get_extent(std::uint64_t offset, std::uint64_t size) const override {
+            offset = std::min(offset, this->fsize);
+            return Extent{ this, offset, std::min(size, this->fsize - offset) };
+        }
+
         bool good() const {
             return this->fp.get() != nullptr;
         }
 
+        int get_fd() const {
+            return fileno(this->fp.get());
+        }
+
         const std::string_view get_path() const {
             return this->path;
         }
@@ -142,6 +180,11 @@ class File final: public FileBase {
 
         std::uint64_t update_size();
 
+        // Number of host files currently opened, shared by clones until the last one is destroyed
+        static std::size_t get_num_open() {
+            return File::num_open;
+        }
+
         virtual std::size_t read(void *dest, std::uint64_t size) override;
         virtual std::size_t write(const void *src, std::uint64_t size) override;
 
@@ -151,11 +194,15 @@ class File final: public FileBase {
     protected:
         struct FileDeleter {
             void operator()(FILE *fp) const {
-                if (fp)
+                if (fp) {
                     fclose(fp);
+                    --File::num_open;
+                }
             }
         };
 
+        static inline std::atomic_size_t num_open = 0;
+
         std::shared_ptr<FILE> fp;
         std::string path;
 };
@@ -182,7 +229,17 @@ class OffsetFile final: public FileBase {
             return std::make_unique<OffsetFile>(*this);
         }
 
+        virtual std::optional<Extent> get_extent(std::uint64_t offset, std::uint64_t size) const override {
+            offset = std::min(offset, this->fsize);
+            return this->base->get_extent(offset + this->offset, std::min(size, this->fsize - offset));
+        }
+
         virtual std::size_t read(void *dest, std::uint64_t size) override;
+        virtual std::size_t read_encoded(void *dest, std::uint64_t size) override;
+
+        virtual void decode(void *data, std::uint64_t size, std::uint64_t offset) const override {
+            this->base->decode(data, size, offset + this->offset);
+        }
 
         virtual std::size_t write(const void *src, std::uint64_t size) override {
             FNX_UNUSED(src, size, offset);
@@ -201,12 +258,12 @@ class CtrFile final: public FileBase {
     public:
         CtrFile() = default;
         CtrFile(std::unique_ptr<FileBase> &&base, crypt::AesCtr &&cipher, std::uint64_t size, std::int64_t offset = 0):
-                base(std::move(base)), offset(offset),
-                cipher(std::make_shared<crypt::AesCtr>(std::move(cipher))), cipher_mtx(std::make_shared<std::mutex>()) {
+                base(std::move(base)), offset(offset), cipher_proto(std::make_shared<crypt::AesCtr>(std::move(cipher))) {
             this->fsize = size;
         }
 
-        CtrFile(const CtrFile &other): base(other.base->clone()), offset(other.offset), cipher(other.cipher), cipher_mtx(other.cipher_mtx) {
+        // Clones get their own cipher, so that they can be decrypted concurrently
+        CtrFile(const CtrFile &other): base(other.base->clone()), offset(other.offset), cipher_proto(other.cipher_proto) {
             this->fsize = other.fsize;
         }
 
@@ -221,6 +278,8 @@ class CtrFile final: public FileBase {
         }
 
         virtual std::size_t read(void *dest, std::uint64_t size) override;
+        virtual std::size_t read_encoded(void *dest, std::uint64_t size) override;
+        virtual void decode(void *data, std::uint64_t size, std::uint64_t offset) const override;
 
         virtual std::size_t write(const void *src, std::uint64_t size) override {
             FNX_UNUSED(src, size, offset);
@@ -230,19 +289,18 @@ class CtrFile final: public FileBase {
         using FileBase::read;
         using FileBase::write;
 
-        std::shared_ptr<crypt::AesCtr> &get_cipher() {
-            return this->cipher;
-        }
-
-        const std::shared_ptr<crypt::AesCtr> &get_cipher() const {
-            return this->cipher;
+        // Cipher state of this file, created on first use from the key shared by all clones
+        crypt::AesCtr &get_cipher() {
+            if (!this->cipher)
+                this->cipher = std::make_unique<crypt::AesCtr>(*this->cipher_proto);
+            return *this->cipher;
         }
 
     private:
         std::unique_ptr<FileBase> base;
         std::size_t offset;
-        std::shared_ptr<crypt::AesCtr> cipher;
-        std::shared_ptr<std::mutex>    cipher_mtx;
+        std::shared_ptr<const crypt::AesCtr> cipher_proto;
+        std::unique_ptr<crypt::AesCtr>       cipher;
 };
 
 } // namespace fnx::io
@@ -20,6 +20,9 @@
 #include <cstdint>
 #include <array>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string_view>
 #include <unordered_map>
 #include <utility>
@@ -38,21 +41,41 @@ using AesKey    = std::array<std::uint8_t, 0x10>;
 using AesXtsKey = std::array<std::uint8_t, 0x20>;
 
 struct KeySet {
-    std::array<AesKey, 0x20> master_keys;
-    std::array<AesKey, 0x20> titlekeks;
+    void set_key(const std::string_view &id, const std::string_view &value);
 
-    AesXtsKey header_key;
+    // Keys may be set while containers are being parsed concurrently, so return copies
+    AesXtsKey get_header_key() const {
+        std::shared_lock lk(this->keys_mtx);
+        return this->header_key;
+    }
 
-    AesKey aes_kek_generation_source,
-        aes_key_generation_source;
+    // Empty if the generation is out of range, as these may be called with the GIL released from the bindings,
+    // where exceptions can't be thrown
+    std::optional<AesKey> get_master_key(std::size_t gen) const {
+        std::shared_lock lk(this->keys_mtx);
+        if (gen >= this->master_keys.size())
+            return {};
+        return this->master_keys[gen];
+    }
 
-    AesKey key_area_key_application_source,
-        key_area_key_ocean_source,
-        key_area_key_system_source;
+    std::optional<AesKey> get_titlekek(std::size_t gen) const {
+        std::shared_lock lk(this->keys_mtx);
+        if (gen >= this->titlekeks.size())
+            return {};
+        return this->titlekeks[gen];
+    }
 
-    void set_key(const std::string_view &id, const std::string_view &value);
+    AesKey get_kaek(std::size_t idx) const;
 
-    const AesKey &get_kaek(std::size_t idx) const;
+    AesKey get_aes_kek_generation_source() const {
+        std::shared_lock lk(this->keys_mtx);
+        return this->aes_kek_generation_source;
+    }
+
+    AesKey get_aes_key_generation_source() const {
+        std::shared_lock lk(this->keys_mtx);
+        return this->aes_key_generation_source;
+    }
 
     static KeySet *get() {
         return KeySet::g_keyset.get();
@@ -63,25 +86,44 @@ struct KeySet {
     }
 
     private:
+        mutable std::shared_mutex keys_mtx;
+
+        std::array<AesKey, 0x20> master_keys = {};
+        std::array<AesKey, 0x20> titlekeks   = {};
+
+        AesXtsKey header_key = {};
+
+        AesKey aes_kek_generation_source = {},
+            aes_key_generation_source = {};
+
+        AesKey key_area_key_application_source = {},
+            key_area_key_ocean_source = {},
+            key_area_key_system_source = {};
+
         static inline std::unique_ptr<KeySet> g_keyset;
 };
 
 struct TitlekeySet {
     void set_cli_key(const std::string_view &key);
     void set_cli_key(const AesKey &key) {
+        std::unique_lock lk(this->map_mtx);
         this->cli_key = std::make_unique<AesKey>(key);
     }
 
     void remove_cli_key() {
+        std::unique_lock lk(this->map_mtx);
         this->cli_key.reset();
     }
 
     void set_key(const std::string_view &id, const std::string_view &value);
     void set_key(const RightsId &id, const AesKey &key) {
+        std::unique_lock lk(this->map_mtx);
         this->map.insert_or_assign(id, key);
     }
 
-    const AesKey &get_key(const RightsId &id) const {
+    // Keys may be added or removed while containers are being parsed concurrently, so return a copy
+    AesKey get_key(const RightsId &id) const {
+        std::shared_lock lk(this->map_mtx);
         if (this->cli_key)
             return *this->cli_key;
         return this->map.at(id);
@@ -104,6 +146,7 @@ struct TitlekeySet {
         };
 
         std::unique_ptr<AesKey> cli_key;
+        mutable std::shared_mutex map_mtx;
         std::unordered_map<RightsId, AesKey, RightsIdHash> map;
 
         static inline std::unique_ptr<TitlekeySet> g_keyset;
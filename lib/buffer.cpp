@@ -0,0 +1,126 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of Fuse-Nx.
+//
+// Fuse-Nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Fuse-Nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Fuse-Nx.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#   include <sys/mman.h>
+#endif
+
+#include <fnx/buffer.hpp>
+
+namespace fnx::io {
+
+namespace {
+
+constexpr std::size_t min_class_shift = std::countr_zero(BufferPool::page_size);
+constexpr std::size_t num_classes     = 20;      // Up to 2GiB
+constexpr std::size_t max_cached      = 4;       // Per size class and thread
+constexpr std::size_t max_shared      = 16;      // Per size class
+
+std::atomic_bool use_hugepages = false;
+
+std::align_val_t alignment(std::size_t cap) {
+    return std::align_val_t((cap >= BufferPool::huge_page_size) ? BufferPool::huge_page_size : BufferPool::page_size);
+}
+
+Buffer::value_type *allocate(std::size_t cap) {
+    auto *ptr = static_cast<Buffer::value_type *>(::operator new(cap, alignment(cap)));
+#ifdef MADV_HUGEPAGE
+    if (use_hugepages && (cap >= BufferPool::huge_page_size))
+        madvise(ptr, cap, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+
+void deallocate(Buffer::value_type *ptr, std::size_t cap) {
+    ::operator delete(ptr, alignment(cap));
+}
+
+std::size_t size_class(std::size_t cap) {
+    return std::countr_zero(cap) - min_class_shift;
+}
+
+struct LocalCache {
+    std::array<std::vector<Buffer::value_type *>, num_classes> free_lists;
+
+    ~LocalCache() {
+        for (std::size_t i = 0; i < num_classes; ++i) {
+            for (auto *ptr: this->free_lists[i])
+                deallocate(ptr, BufferPool::page_size << i);
+        }
+    }
+};
+
+// Second tier, for buffers released on a different thread than the one acquiring them (eg. producer/consumer pipelines)
+struct SharedCache: LocalCache {
+    std::mutex mtx;
+};
+
+thread_local LocalCache local_cache;
+SharedCache shared_cache;
+
+} // namespace
+
+Buffer BufferPool::acquire(std::size_t size) {
+    auto cap = std::bit_ceil(std::max(size, BufferPool::page_size));
+    if (auto cls = size_class(cap); cls < num_classes) {
+        if (auto &list = local_cache.free_lists[cls]; !list.empty()) {
+            auto *ptr = list.back();
+            list.pop_back();
+            return Buffer(ptr, size, cap);
+        }
+
+        std::scoped_lock lk(shared_cache.mtx);
+        if (auto &list = shared_cache.free_lists[cls]; !list.empty()) {
+            auto *ptr = list.back();
+            list.pop_back();
+            return Buffer(ptr, size, cap);
+        }
+    }
+
+    return Buffer(allocate(cap), size, cap);
+}
+
+void BufferPool::set_use_hugepages(bool use) {
+    use_hugepages = use;
+}
+
+void BufferPool::release(Buffer::value_type *ptr, std::size_t cap) {
+    if (auto cls = size_class(cap); cls < num_classes) {
+        if (auto &list = local_cache.free_lists[cls]; list.size() < max_cached) {
+            list.push_back(ptr);
+            return;
+        }
+
+        std::scoped_lock lk(shared_cache.mtx);
+        if (auto &list = shared_cache.free_lists[cls]; list.size() < max_shared) {
+            list.push_back(ptr);
+            return;
+        }
+    }
+
+    deallocate(ptr, cap);
+}
+
+} // namespace fnx::io
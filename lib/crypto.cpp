@@ -15,10 +15,54 @@
 // You should have received a copy of the GNU General Public License
 // along with Fuse-Nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstring>
+
 #include <fnx/crypto.hpp>
 
 namespace fnx::crypt {
 
+namespace {
+
+// Tables for slice-by-8 processing, where table[k][b] is the CRC of byte b followed by k zero bytes
+constexpr auto crc32_tables = [] {
+    std::array<std::array<std::uint32_t, 0x100>, 8> tables = {};
+    for (std::uint32_t i = 0; i < 0x100; ++i) {
+        auto crc = i;
+        for (int j = 0; j < 8; ++j)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+        tables[0][i] = crc;
+    }
+
+    for (std::size_t k = 1; k < tables.size(); ++k) {
+        for (std::uint32_t i = 0; i < 0x100; ++i)
+            tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+    }
+    return tables;
+}();
+
+} // namespace
+
+void Crc32::update(const void *data, std::size_t size) {
+    auto *ptr = static_cast<const std::uint8_t *>(data);
+    auto &t   = crc32_tables;
+    auto crc  = this->crc;
+
+    // Processes 8 bytes per iteration with independent table lookups (little-endian hosts)
+    for (; size >= 8; ptr += 8, size -= 8) {
+        std::uint32_t lo, hi;
+        std::memcpy(&lo, ptr,     sizeof(lo));
+        std::memcpy(&hi, ptr + 4, sizeof(hi));
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+
+    for (; size; ++ptr, --size)
+        crc = (crc >> 8) ^ t[0][(crc ^ *ptr) & 0xff];
+
+    this->crc = crc;
+}
+
 AesKey gen_aes_kek(const AesKey &src, const AesKey &mkey, const AesKey &kek_seed, const AesKey &key_seed) {
     AesKey key, kek;
     AesEcb(mkey).decrypt(kek_seed, key);
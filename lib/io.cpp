@@ -18,6 +18,7 @@
 #include <cstring>
 #include <cinttypes>
 
+#include <fnx/buffer.hpp>
 #include <fnx/io.hpp>
 
 #ifdef __MINGW32__
@@ -27,11 +28,17 @@
 namespace fnx::io {
 
 bool File::open(const std::string_view &path, const char *mode) {
-    if (this->fp.get())
-        fclose(this->fp.get());
+    // The previous file is closed once its clones are destroyed
     this->path = path;
     this->fp   = std::shared_ptr<FILE>(fopen(path.data(), mode), FileDeleter());
-    return this->fp != nullptr;
+    if (!this->fp)
+        return false;
+
+    ++File::num_open;
+
+    // Extents are bounded by the size of the file
+    this->update_size();
+    return true;
 }
 
 std::uint64_t File::update_size() {
@@ -96,26 +103,61 @@ std::size_t OffsetFile::read(void *dest, std::uint64_t size) {
     return this->base->read(dest, clamped_size);
 }
 
+std::size_t OffsetFile::read_encoded(void *dest, std::uint64_t size) {
+    auto clamped_pos  = std::clamp(static_cast<std::uint64_t>(this->pos), static_cast<std::uint64_t>(0), this->fsize);
+    auto clamped_size = std::clamp(size, static_cast<std::uint64_t>(0), this->fsize - clamped_pos);
+
+    this->pos += size;
+    this->base->seek(clamped_pos + this->offset);
+    return this->base->read_encoded(dest, clamped_size);
+}
+
 std::size_t CtrFile::read(void *dest, std::uint64_t size) {
-    auto aligned_pos  = utils::align_down(std::clamp(static_cast<std::uint64_t>(this->pos),
-        static_cast<std::uint64_t>(0), this->fsize), crypt::AesCtr::block_size), pos_diff = this->pos - aligned_pos;
+    auto clamped_pos  = std::clamp(static_cast<std::uint64_t>(this->pos), static_cast<std::uint64_t>(0), this->fsize);
+    auto aligned_pos  = utils::align_down(clamped_pos, crypt::AesCtr::block_size), pos_diff = this->pos - aligned_pos;
     auto aligned_size = utils::align_up(std::clamp(size + pos_diff, static_cast<std::uint64_t>(0),
         this->fsize - aligned_pos), crypt::AesCtr::block_size);
 
-    std::scoped_lock lk(*this->cipher_mtx);
+    auto &cipher = this->get_cipher();
     this->base->seek(aligned_pos + this->offset);
-    this->cipher->set_ctr((aligned_pos + this->offset) >> 4);
-    if (aligned_size <= size) {
-        this->base->read(dest, aligned_size);
-        this->cipher->decrypt(dest, size);
-    } else { // Sad path, data doesn't fit and we have to allocate a new buffer
-        auto read = this->base->read(aligned_size);
-        this->cipher->decrypt(read);
-        std::copy_n(read.begin() + pos_diff, std::min(size, read.size() - pos_diff), reinterpret_cast<std::uint8_t *>(dest));
+    cipher.set_ctr((aligned_pos + this->offset) >> 4);
+    std::size_t read;
+    if (!pos_diff && (aligned_size <= size)) {
+        read = this->base->read(dest, aligned_size);
+        cipher.decrypt(dest, read);
+    } else { // Sad path, data doesn't fit and we have to use an intermediate buffer
+        auto buf = BufferPool::acquire(aligned_size);
+        read = this->base->read(buf.data(), aligned_size);
+        cipher.decrypt(buf.data(), read);
+        read = (read > pos_diff) ? read - pos_diff : 0;
+        std::copy_n(buf.begin() + pos_diff, std::min(size, read), reinterpret_cast<std::uint8_t *>(dest));
     }
 
+    // Only count data that was actually read, and not the padding of the last block
+    this->pos += size;
+    return std::min({ size, static_cast<std::uint64_t>(read), this->fsize - clamped_pos });
+}
+
+std::size_t CtrFile::read_encoded(void *dest, std::uint64_t size) {
+    auto clamped_pos  = std::clamp(static_cast<std::uint64_t>(this->pos), static_cast<std::uint64_t>(0), this->fsize);
+    auto clamped_size = std::clamp(size, static_cast<std::uint64_t>(0), this->fsize - clamped_pos);
+
     this->pos += size;
-    return size;
+    this->base->seek(clamped_pos + this->offset);
+    return this->base->read(dest, clamped_size);
+}
+
+void CtrFile::decode(void *data, std::uint64_t size, std::uint64_t offset) const {
+    auto pos = offset + this->offset, aligned_pos = utils::align_down(pos, crypt::AesCtr::block_size);
+
+    // Use a private cipher so that chunks of the same file can be decoded concurrently
+    crypt::AesCtr cipher(*this->cipher_proto);
+    cipher.set_ctr(aligned_pos >> 4);
+    if (auto diff = pos - aligned_pos; diff) { // Skip the keystream preceding the data
+        std::array<std::uint8_t, crypt::AesCtr::block_size> skip = {};
+        cipher.decrypt(skip.data(), diff);
+    }
+    cipher.decrypt(data, size);
 }
 
 } // namespace fnx::io
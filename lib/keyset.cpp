@@ -66,6 +66,8 @@ void KeySet::set_key(const std::string_view &id, const std::string_view &value)
     std::size_t mkey_len = std::strlen("master_key_");
     std::size_t tkek_len = std::strlen("titlekek_");
 
+    std::unique_lock lk(this->keys_mtx);
+
     if (id == "aes_kek_generation_source")
         this->aes_kek_generation_source       = to_hex_array<AesKey>(value);
     else if (id == "aes_key_generation_source")
@@ -87,7 +89,8 @@ void KeySet::set_key(const std::string_view &id, const std::string_view &value)
     }
 }
 
-const AesKey &KeySet::get_kaek(std::size_t idx) const {
+AesKey KeySet::get_kaek(std::size_t idx) const {
+    std::shared_lock lk(this->keys_mtx);
     switch (idx) {
         default:
         case 0:
@@ -80,10 +80,13 @@ Nca::SectionInfo Nca::make_section_info(const FsEntry &entry, const Nca::FsHeade
 }
 
 void Nca::decrypt_header(Header &header) {
-    static bool init_ctx = false;
-    static crypt::AesXtsNintendo ctx;
-    if (!init_ctx) {
-        ctx = crypt::AesXtsNintendo(crypt::KeySet::get()->header_key);
+    // Per-thread, as headers may be decrypted concurrently, and recreated if the key was changed since
+    thread_local bool init_ctx = false;
+    thread_local crypt::AesXtsKey ctx_key;
+    thread_local crypt::AesXtsNintendo ctx;
+    if (auto key = crypt::KeySet::get()->get_header_key(); !init_ctx || (key != ctx_key)) {
+        ctx = crypt::AesXtsNintendo(key);
+        ctx_key  = key;
         init_ctx = true;
     } else {
         ctx.set_sector(0);
@@ -129,16 +132,28 @@ bool Nca::decrypt_titlekey() {
         return false;
     }
 
-    auto &tkek = crypt::KeySet::get()->titlekeks[this->crypto_type];
-    crypt::AesEcb(tkek).decrypt(tkey, this->body_key);
+    auto tkek = crypt::KeySet::get()->get_titlekek(this->crypto_type);
+    if (!tkek) {
+        std::fprintf(stderr, "Title kek for generation %d missing\n", this->crypto_type);
+        return false;
+    }
+
+    crypt::AesEcb(*tkek).decrypt(tkey, this->body_key);
     return true;
 }
 
-void Nca::decrypt_keyarea() {
+bool Nca::decrypt_keyarea() {
     auto *set = crypt::KeySet::get();
-    auto area_key = crypt::gen_aes_kek(set->get_kaek(this->header.kaek_idx), set->master_keys[this->crypto_type],
-        set->aes_kek_generation_source, set->aes_key_generation_source);
+    auto master_key = set->get_master_key(this->crypto_type);
+    if (!master_key) {
+        std::fprintf(stderr, "Master key for generation %d missing\n", this->crypto_type);
+        return false;
+    }
+
+    auto area_key = crypt::gen_aes_kek(set->get_kaek(this->header.kaek_idx), *master_key,
+        set->get_aes_kek_generation_source(), set->get_aes_key_generation_source());
     crypt::AesEcb(area_key).decrypt(this->header.key_area);
+    return true;
 }
 
 bool Nca::parse() {
@@ -151,7 +166,8 @@ bool Nca::parse() {
         if (!this->decrypt_titlekey())
             return false;
     } else {
-        this->decrypt_keyarea();
+        if (!this->decrypt_keyarea())
+            return false;
         this->body_key = this->header.key_area[2];
     }
 
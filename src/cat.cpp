@@ -0,0 +1,130 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __MINGW32__
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#ifdef __linux__
+#   include <fcntl.h>
+#   include <sys/sendfile.h>
+#endif
+
+#include "vfs.hpp"
+#include "utils.hpp"
+
+#include "cat.hpp"
+
+namespace fnx {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::size_t chunk_size = 0x100000; // 1MiB
+
+// Hands plaintext data from the host file over to the kernel, without going through user space
+// Returns the number of bytes sent, which is short if the kernel can't transfer between these files
+std::uint64_t send_extent(int out_fd, bool is_pipe, const io::Extent &extent) {
+#ifdef __linux__
+    auto in_fd = extent.file->get_fd();
+    std::uint64_t sent = 0;
+    while (sent < extent.size) {
+        ssize_t rc;
+        if (is_pipe) {
+            auto off = static_cast<loff_t>(extent.offset + sent);
+            rc = splice(in_fd, &off, out_fd, nullptr, extent.size - sent, SPLICE_F_MORE);
+        } else {
+            auto off = static_cast<off_t>(extent.offset + sent);
+            rc = sendfile(out_fd, in_fd, &off, extent.size - sent);
+        }
+        if (rc <= 0)
+            break;
+        sent += rc;
+    }
+    return sent;
+#else
+    FNX_UNUSED(out_fd, is_pipe, extent);
+    return 0;
+#endif
+}
+
+} // namespace
+
+int CatContext::run(const Options &options) {
+    auto path = FileSystem::normalize_path(PATHSTR(fs::path("/") / this->path));
+
+    // Expands the containers along the path, so that the file gets registered
+    this->filesys->find_folder(fs::path(path).parent_path());
+    auto opt = this->filesys->get_file(path);
+    if (!opt) {
+        std::fprintf(stderr, "Could not find file \"%s\" inside container \"%s\"\n",
+            PATHSTR(this->path).c_str(), PATHSTR(this->container).c_str());
+        return 1;
+    }
+
+    auto &src = **opt;
+    auto size = src.get_size();
+    if (options.offset > size) {
+        std::fprintf(stderr, "Offset is past the end of the file (%#jx)\n", static_cast<std::uintmax_t>(size));
+        return 1;
+    }
+
+#ifdef __MINGW32__
+    _setmode(_fileno(stdout), _O_BINARY);
+    bool is_pipe = false;
+#else
+    struct stat st;
+    bool is_pipe = !fstat(fileno(stdout), &st) && S_ISFIFO(st.st_mode);
+#endif
+
+    auto base = src.open();
+    auto buf  = io::BufferPool::acquire(chunk_size);
+    bool try_send = true;
+    for (auto offset = options.offset, end = offset + std::min(options.length, size - offset); offset < end;) {
+        if (auto extent = try_send ? src.get_extent(offset, end - offset) : std::nullopt; extent) {
+            std::fflush(stdout);
+            auto sent = send_extent(fileno(stdout), is_pipe, *extent);
+            offset  += sent;
+            try_send = sent && (sent == extent->size);
+            continue;
+        }
+
+        auto read = base->read_at(offset, buf.data(), std::min(buf.capacity(), end - offset));
+        if (!read) {
+            std::fprintf(stderr, "Failed to read \"%s\" at offset %#jx\n", path.c_str(), static_cast<std::uintmax_t>(offset));
+            return 1;
+        }
+
+        if (std::fwrite(buf.data(), 1, read, stdout) != read) {
+            std::perror("Failed to write");
+            return 1;
+        }
+        offset += read;
+    }
+
+    return std::fflush(stdout) ? 1 : 0;
+}
+
+} // namespace fnx
@@ -15,6 +15,8 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include "utils.hpp"
+
 #include "containers.hpp"
 
 namespace fnx {
@@ -30,13 +32,71 @@ constexpr std::array extension_whitelist = {
     "nca"sv, "nsp"sv, "pfs"sv, "romfs"sv, "hfs"sv, "xci"sv,
 };
 
-constexpr bool should_try_container(std::string_view name) {
+void try_load_ticket_key(ContainerBase *container) {
+    for (auto &&[name, file, _]: container->read_files()) {
+        constexpr std::size_t tik_size = 0x2c0;
+        if (name.ends_with(".tik") && file->size() >= tik_size) {
+            auto dat = file->read(tik_size);
+
+            std::fprintf(stderr, "Detected ticket %s, loading title key\n", name.c_str());
+
+            RightsId rights_id;
+            std::copy_n(dat.data() + 0x2a0, sizeof(rights_id), rights_id.begin());
+
+            crypt::AesKey key;
+            std::copy_n(dat.data() + 0x180, sizeof(key), key.begin());
+
+            crypt::TitlekeySet::get()->set_key(rights_id, key);
+        }
+    }
+}
+
+} // namespace
+
+bool should_try_container(std::string_view name) {
     auto ext = name.substr(name.rfind('.') + 1);
     return std::find(extension_whitelist.begin(), extension_whitelist.end(), ext) !=
         extension_whitelist.end();
 }
 
-} // namespace
+std::unique_ptr<ContainerBase> ContainerBase::open(std::unique_ptr<io::FileBase> &&base) {
+    std::unique_ptr<ContainerBase> container;
+
+    // Zero-filled past the end of the file, so that small files can't match on stale data
+    auto header = io::BufferPool::acquire(0x400);
+    auto read   = base->read_at(0, header.data(), header.size());
+    std::fill(header.begin() + read, header.end(), 0);
+
+    auto fmt = hac::match(header);
+    switch (fmt) {
+        case hac::Format::Pfs:
+            container = std::make_unique<PfsContainer>(std::move(base));
+            break;
+        case hac::Format::Hfs:
+            container = std::make_unique<HfsContainer>(std::move(base));
+            break;
+        case hac::Format::RomFs:
+            container = std::make_unique<RomFsContainer>(std::move(base));
+            break;
+        case hac::Format::Nca:
+            container = std::make_unique<NcaContainer>(std::move(base));
+            break;
+        case hac::Format::Xci:
+            container = std::make_unique<XciContainer>(std::move(base));
+            break;
+        case hac::Format::Unknown:
+        default:
+            return nullptr;
+    }
+
+    if (!container->parse())
+        return nullptr;
+
+    if (fmt == hac::Format::Pfs)
+        try_load_ticket_key(container.get());
+
+    return container;
+}
 
 std::vector<FileEntry> PfsContainer::read_files() {
     std::vector<FileEntry> out;
@@ -54,9 +114,27 @@ std::vector<FileEntry> HfsContainer::read_files() {
     return out;
 }
 
+void RomFsContainer::release() {
+    if (this->path != "/")
+        return;
+
+    // Only keep the header around, the tables will be read again when needed
+    std::scoped_lock lk(*this->parse_mtx);
+    this->container = std::make_shared<hac::RomFs>(this->container->clone_base());
+}
+
+hac::RomFs::DirEntry *RomFsContainer::find_dir() {
+    if (this->path == "/") {
+        std::scoped_lock lk(*this->parse_mtx);
+        if (!this->container->get_dir_nb())
+            this->container->parse();
+    }
+    return this->container->find_dir(this->path);
+}
+
 std::vector<FileEntry> RomFsContainer::read_files() {
     std::vector<FileEntry> out;
-    auto *dir = this->container->find_dir(this->path);
+    auto *dir = this->find_dir();
     if (!dir)
         return out;
 
@@ -69,7 +147,7 @@ std::vector<FileEntry> RomFsContainer::read_files() {
 
 std::vector<DirEntry> RomFsContainer::read_folders() {
     std::vector<DirEntry> out;
-    auto *dir = this->container->find_dir(this->path);
+    auto *dir = this->find_dir();
     if (!dir)
         return out;
 
@@ -92,6 +170,11 @@ std::vector<FileEntry> NcaContainer::read_files() {
     return out;
 }
 
+std::string_view NcaContainer::content_type() const {
+    auto type = static_cast<std::size_t>(this->container->get_content_type());
+    return (type < content_type_names.size()) ? content_type_names[type] : std::string_view();
+}
+
 std::vector<FileEntry> XciContainer::read_files() {
     std::vector<FileEntry> out;
     out.reserve(this->container->get_num_partitions());
@@ -100,4 +183,32 @@ std::vector<FileEntry> XciContainer::read_files() {
     return out;
 }
 
+ContainerBase *HostContainer::get_container() {
+    if (!this->container) {
+        auto file = std::make_unique<io::File>(PATHSTR(this->path).c_str());
+        if (!file->good()) {
+            std::fprintf(stderr, "Failed to open \"%s\"\n", PATHSTR(this->path).c_str());
+            return nullptr;
+        }
+
+        file->update_size();
+        if (this->container = ContainerBase::open(std::move(file)); !this->container)
+            std::fprintf(stderr, "Unrecognized file type for \"%s\"\n", PATHSTR(this->path).c_str());
+    }
+
+    return this->container.get();
+}
+
+std::vector<FileEntry> HostContainer::read_files() {
+    std::scoped_lock lk(this->container_mtx);
+    auto *container = this->get_container();
+    return container ? container->read_files() : std::vector<FileEntry>{};
+}
+
+std::vector<DirEntry> HostContainer::read_folders() {
+    std::scoped_lock lk(this->container_mtx);
+    auto *container = this->get_container();
+    return container ? container->read_folders() : std::vector<DirEntry>{};
+}
+
 } // namespace fnx
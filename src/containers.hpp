@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <filesystem>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -43,9 +44,27 @@ struct ContainerBase {
         return {};
     }
 
+    // Drops any state that can be regenerated by the next read_files/read_folders call
+    virtual void release() { }
+
+    // Memory held by parsed metadata, in bytes
+    virtual std::size_t footprint() const {
+        return 0;
+    }
+
     virtual std::string_view name() const = 0;
+
+    // Type of the content, for formats which record it
+    virtual std::string_view content_type() const {
+        return {};
+    }
+
+    // Probes the format of a file and parses it, returning nullptr if it isn't a valid container
+    static std::unique_ptr<ContainerBase> open(std::unique_ptr<io::FileBase> &&base);
 };
 
+bool should_try_container(std::string_view name);
+
 template <typename T>
 struct Container: public ContainerBase {
     public:
@@ -86,9 +105,21 @@ class RomFsContainer final: public Container<hac::RomFs> {
             Container(other.container),
             parse_mtx(other.parse_mtx), parsed(false), path(std::move(path)) { }
 
+        // Only the header is checked, the tables are read when the contents are first listed
+        virtual bool parse() override {
+            return this->container->is_valid();
+        }
+
         virtual std::vector<FileEntry> read_files()   override;
         virtual std::vector<DirEntry>  read_folders() override;
 
+        // The tables are owned by the root container, and released along with it
+        virtual void release() override;
+
+        virtual std::size_t footprint() const override {
+            return (this->path == "/") ? this->container->get_meta_size() : 0;
+        }
+
         void parse_dir(hac::RomFs::DirEntry *dir) {
             std::scoped_lock lk(*this->parse_mtx);
             if (!this->parsed) {
@@ -101,6 +132,9 @@ class RomFsContainer final: public Container<hac::RomFs> {
             RomFsContainer::search_containers = search;
         }
 
+    private:
+        hac::RomFs::DirEntry *find_dir();
+
     private:
         static inline bool search_containers = false;
 
@@ -114,6 +148,7 @@ class NcaContainer final: public Container<hac::Nca> {
     public:
         NcaContainer(std::unique_ptr<io::FileBase> &&base): Container(std::move(base)) { }
         virtual std::vector<FileEntry> read_files() override;
+        virtual std::string_view content_type() const override;
 
     private:
         constexpr static std::array section_names = {
@@ -122,6 +157,15 @@ class NcaContainer final: public Container<hac::Nca> {
             std::string_view("section 2"),
             std::string_view("section 3"),
         };
+
+        constexpr static std::array content_type_names = {
+            std::string_view("Program"),
+            std::string_view("Meta"),
+            std::string_view("Control"),
+            std::string_view("Manual"),
+            std::string_view("Data"),
+            std::string_view("PublicData"),
+        };
 };
 
 class XciContainer final: public Container<hac::Xci> {
@@ -130,4 +174,35 @@ class XciContainer final: public Container<hac::Xci> {
         virtual std::vector<FileEntry> read_files() override;
 };
 
+// Container stored in a file of the host filesystem, which is only opened and parsed once its contents are requested
+class HostContainer final: public ContainerBase {
+    public:
+        HostContainer(std::filesystem::path path): path(std::move(path)) { }
+
+        virtual bool parse() override {
+            return true;
+        }
+
+        virtual std::vector<FileEntry> read_files()   override;
+        virtual std::vector<DirEntry>  read_folders() override;
+
+        virtual void release() override {
+            std::scoped_lock lk(this->container_mtx);
+            this->container.reset();
+        }
+
+        virtual std::string_view name() const override {
+            return "Host";
+        }
+
+    private:
+        ContainerBase *get_container();
+
+    private:
+        std::filesystem::path path;
+
+        std::mutex container_mtx;
+        std::unique_ptr<ContainerBase> container;
+};
+
 } // namespace fnx
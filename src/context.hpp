@@ -18,6 +18,7 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 
 #include "vfs.hpp"
 #include "utils.hpp"
@@ -25,14 +26,19 @@
 namespace fnx {
 
 struct Context {
-    Context(const std::filesystem::path &container): container(container) {
+    // Exits with the given status if the container isn't recognized
+    Context(const std::filesystem::path &container, int error_status = EXIT_FAILURE): container(container) {
         this->filesys = std::make_unique<FileSystem>(container);
         if (auto dir = this->filesys->get_folder("/"); !dir) {
             std::fprintf(stderr, "Unrecognized file type for \"%s\"\n", PATHSTR(container).c_str());
-            std::exit(EXIT_FAILURE);
+            std::exit(error_status);
         }
     }
 
+    Context(const std::vector<std::filesystem::path> &containers): container(containers.front()) {
+        this->filesys = std::make_unique<FileSystem>(containers);
+    }
+
     protected:
         std::filesystem::path container;
         std::unique_ptr<FileSystem> filesys;
@@ -15,7 +15,39 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef __MINGW32__
+#   include <fcntl.h>
+#   include <unistd.h>
+#else
+#   include <fcntl.h>
+#   include <io.h>
+#endif
+
+#ifdef __linux__
+#   include <linux/fs.h>
+#   include <sys/ioctl.h>
+#endif
 
 #include "thread_pool.hpp"
 #include "vfs.hpp"
@@ -34,61 +66,844 @@ fs::path operator +(const fs::path &lhs, const fs::path &rhs) {
     return path += rhs;
 }
 
+constexpr std::size_t   chunk_size = 0x400000;  // 4MiB
+constexpr std::uint64_t range_size = 0x4000000; // 64MiB
+
+// Record of the completed files, and ranges of large files, kept in the destination so that an interrupted dump can be resumed
+// Entries are identified by their path along with the size and location of their source, so that changed entries are dumped again
+class Manifest {
+    public:
+        constexpr static std::string_view name = ".fnx-manifest";
+
+        struct Entry {
+            std::uint64_t size = 0, host_offset = 0;
+            bool complete = false;
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges; // Offset, size
+            std::vector<std::string> digests; // Names of the recorded algorithms
+        };
+
+    public:
+        // Unless kept, the manifest is only left behind by a dump that didn't complete, for it to be resumed
+        Manifest(const fs::path &path, bool resume, bool keep): path(path), keep(keep) {
+            if (resume)
+                this->load(path);
+
+            // Records are only appended, the latest one for a path takes precedence when loading
+            if (this->fp = std::fopen(PATHSTR(path).c_str(), resume ? "a" : "w"); !this->fp)
+                std::fprintf(stderr, "Failed to open manifest \"%s\", the dump will not be resumable\n", PATHSTR(path).c_str());
+        }
+
+        ~Manifest() {
+            if (!this->fp)
+                return;
+
+            std::fclose(this->fp);
+            if (!this->keep && !this->incomplete) {
+                std::error_code ec;
+                fs::remove(this->path, ec);
+            }
+        }
+
+        void set_incomplete() {
+            this->incomplete = true;
+        }
+
+        const Entry *find(const std::string &path, std::uint64_t size, std::uint64_t host_offset) const {
+            auto it = this->entries.find(path);
+            if ((it == this->entries.end()) || (it->second.size != size) || (it->second.host_offset != host_offset))
+                return nullptr;
+            return &it->second;
+        }
+
+        void add_file(const std::string &path, std::uint64_t size, std::uint64_t host_offset) {
+            this->append("F\t%" PRIu64 "\t%" PRIu64 "\t%s\n", size, host_offset, path.c_str());
+        }
+
+        void add_range(const std::string &path, std::uint64_t size, std::uint64_t host_offset,
+                std::uint64_t offset, std::uint64_t length) {
+            this->append("R\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+                size, host_offset, offset, length, path.c_str());
+        }
+
+        void add_digest(const std::string &path, std::uint64_t size, std::uint64_t host_offset,
+                const char *algo, const std::string &digest) {
+            this->append("H\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\t%s\n",
+                size, host_offset, algo, digest.c_str(), path.c_str());
+        }
+
+    private:
+        void load(const fs::path &path) {
+            auto *fp = std::fopen(PATHSTR(path).c_str(), "r");
+            if (!fp)
+                return;
+            FNX_SCOPEGUARD([fp] { std::fclose(fp); });
+
+            std::array<char, 0x1000> line;
+            while (std::fgets(line.data(), line.size(), fp)) {
+                std::uint64_t size, host_offset, offset = 0, length = 0;
+                std::array<char, 0x10> algo = {};
+                int pos = 0;
+                bool is_file = std::sscanf(line.data(), "F\t%" SCNu64 "\t%" SCNu64 "\t%n", &size, &host_offset, &pos) == 2;
+                bool is_hash = !is_file && (std::sscanf(line.data(), "H\t%" SCNu64 "\t%" SCNu64 "\t%15[a-z0-9]\t%*[0-9a-f]\t%n",
+                        &size, &host_offset, algo.data(), &pos) == 3) && pos;
+                if (!is_file && !is_hash && (std::sscanf(line.data(), "R\t%" SCNu64 "\t%" SCNu64 "\t%" SCNu64 "\t%" SCNu64 "\t%n",
+                        &size, &host_offset, &offset, &length, &pos) != 4))
+                    continue;
+
+                // Lines cut short by an interruption are missing their terminator
+                std::string_view entry_path(line.data() + pos);
+                if (!entry_path.ends_with('\n'))
+                    continue;
+                entry_path.remove_suffix(1);
+
+                auto &entry = this->entries[std::string(entry_path)];
+                if ((entry.size != size) || (entry.host_offset != host_offset))
+                    entry = Entry{ size, host_offset, false, {}, {} };
+
+                if (is_file)
+                    entry.complete = true;
+                else if (is_hash)
+                    entry.digests.emplace_back(algo.data());
+                else
+                    entry.ranges.emplace_back(offset, length);
+            }
+        }
+
+        template <typename ...Args>
+        void append(const char *fmt, Args &&...args) {
+            if (!this->fp)
+                return;
+
+            std::scoped_lock lk(this->mtx);
+            std::fprintf(this->fp, fmt, std::forward<Args>(args)...);
+            std::fflush(this->fp);
+        }
+
+    private:
+        std::mutex mtx;
+        std::FILE *fp = nullptr;
+        std::unordered_map<std::string, Entry> entries;
+
+        fs::path path;
+        bool keep;
+        std::atomic_bool incomplete = false;
+};
+
+// Written as a reduction over words, which compilers vectorize
+bool is_zero(const std::uint8_t *data, std::size_t size) {
+    std::uint64_t acc = 0;
+    for (; size >= sizeof(std::uint64_t); data += sizeof(std::uint64_t), size -= sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        acc |= word;
+    }
+    for (; size; ++data, --size)
+        acc |= *data;
+    return !acc;
+}
+
+template <std::size_t N>
+std::string to_hex(const std::array<std::uint8_t, N> &bytes) {
+    std::string str(2 * N, '\0');
+    for (std::size_t i = 0; i < N; ++i) {
+        str[2 * i]     = "0123456789abcdef"[bytes[i] >> 4];
+        str[2 * i + 1] = "0123456789abcdef"[bytes[i] & 0xf];
+    }
+    return str;
+}
+
+// Closed once the last chunk referencing it was written, at which point it is recorded to the manifest unless writing failed
+struct OutputFile {
+    OutputFile(std::FILE *fp, Manifest &manifest, const std::string &path, std::uint64_t size, std::uint64_t host_offset,
+            bool sparse, bool reopened):
+        fp(fp), sparse(sparse), reopened(reopened), valid_size(size), manifest(manifest), path(path), size(size), host_offset(host_offset) { }
+
+    ~OutputFile() {
+        // Preallocated space past a failure would read back as zeros, it is cut so that the file is visibly incomplete
+        if (this->failed && (this->valid_size < this->size))
+            this->truncate(this->valid_size);
+
+        std::fclose(this->fp);
+        if (this->failed) {
+            this->manifest.set_incomplete();
+            return;
+        }
+
+        // Digests are recorded first, so that a complete file always has them
+        if (this->sha256)
+            this->manifest.add_digest(this->path, this->size, this->host_offset, "sha256", to_hex(this->sha256->finalize()));
+        if (this->crc32) {
+            auto crc = this->crc32->finalize();
+            this->manifest.add_digest(this->path, this->size, this->host_offset, "crc32",
+                to_hex(std::array<std::uint8_t, 4>{ std::uint8_t(crc >> 24), std::uint8_t(crc >> 16), std::uint8_t(crc >> 8), std::uint8_t(crc) }));
+        }
+        this->manifest.add_file(this->path, this->size, this->host_offset);
+    }
+
+    // Marks data from this offset as not written
+    void fail_at(std::uint64_t offset) {
+        auto cur = this->valid_size.load();
+        while ((offset < cur) && !this->valid_size.compare_exchange_weak(cur, offset));
+        this->failed = true;
+    }
+
+    // Must be fed the whole content in order
+    void hash(const std::uint8_t *data, std::size_t size) {
+        if (this->sha256)
+            this->sha256->update(data, size);
+        if (this->crc32)
+            this->crc32->update(data, size);
+    }
+
+    // Reserves the space up front, as ranges are written out of order
+    void preallocate(std::uint64_t size) {
+#ifdef __linux__
+        if (size)
+            fallocate(fileno(this->fp), 0, 0, size);
+#else
+        FNX_UNUSED(size);
+#endif
+    }
+
+    // Sets the size without allocating, blocks that are never written are left as holes
+    bool truncate(std::uint64_t size) {
+#ifdef __MINGW32__
+        return !_chsize_s(_fileno(this->fp), size);
+#else
+        return !ftruncate(fileno(this->fp), size);
+#endif
+    }
+
+    // Writes runs of non-zero blocks, and skips the zero-filled ones
+    // A file reopened to be resumed may have been preallocated, its zero-filled blocks are deallocated instead
+    bool write_sparse_at(std::uint64_t offset, const std::uint8_t *data, std::size_t size) {
+        for (std::size_t pos = 0; pos < size;) {
+            auto zero = is_zero(data + pos, std::min(sparse_block, size - pos));
+            auto end  = pos + std::min(sparse_block, size - pos);
+            while ((end < size) && (is_zero(data + end, std::min(sparse_block, size - end)) == zero))
+                end += std::min(sparse_block, size - end);
+
+            if (!zero && !this->write_at(offset + pos, data + pos, end - pos))
+                return false;
+#ifdef __linux__
+            if (zero && this->reopened)
+                fallocate(fileno(this->fp), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset + pos, end - pos);
+#endif
+            pos = end;
+        }
+        return true;
+    }
+
+    bool write_at(std::uint64_t offset, const std::uint8_t *data, std::size_t size) {
+#ifdef __MINGW32__
+        return !_fseeki64(this->fp, offset, SEEK_SET) && (std::fwrite(data, 1, size, this->fp) == size);
+#else
+        while (size) {
+            auto written = pwrite(fileno(this->fp), data, size, offset);
+            if (written <= 0)
+                return false;
+            data += written, offset += written, size -= written;
+        }
+        return true;
+#endif
+    }
+
+    // Copies plaintext data from the host file within the kernel, sharing the extents when the filesystem supports it
+    // Returns the number of bytes copied, 0 if the kernel can't copy between these files
+    std::uint64_t copy_at(std::uint64_t offset, const io::Extent &extent) {
+#ifdef __linux__
+        auto in_fd = extent.file->get_fd(), out_fd = fileno(this->fp);
+
+        // Cloning works on whole filesystem blocks
+        if (((extent.offset | offset | extent.size) % clone_align) == 0) {
+            struct file_clone_range range = {
+                .src_fd      = in_fd,
+                .src_offset  = extent.offset,
+                .src_length  = extent.size,
+                .dest_offset = offset,
+            };
+            if (ioctl(out_fd, FICLONERANGE, &range) == 0)
+                return extent.size;
+        }
+
+        // Copies would write zero-filled blocks out
+        if (this->sparse)
+            return 0;
+
+        auto in_off = static_cast<loff_t>(extent.offset), out_off = static_cast<loff_t>(offset);
+        std::uint64_t copied = 0;
+        while (copied < extent.size) {
+            auto rc = copy_file_range(in_fd, &in_off, out_fd, &out_off, extent.size - copied, 0);
+            if (rc <= 0)
+                break;
+            copied += rc;
+        }
+        return copied;
+#else
+        FNX_UNUSED(offset, extent);
+        return 0;
+#endif
+    }
+
+    constexpr static std::uint64_t clone_align  = 0x1000;
+    constexpr static std::size_t   sparse_block = 0x1000;
+
+    std::FILE *fp;
+    std::atomic_bool failed = false;
+    bool sparse, reopened;
+    std::atomic_uint64_t valid_size; // Size of the data written before the first failure
+
+    Manifest &manifest;
+    std::string path;
+    std::uint64_t size, host_offset;
+
+    std::optional<crypt::Sha256> sha256;
+    std::optional<crypt::Crc32>  crc32;
+};
+
+// Range of an output file, completed once the last chunk referencing it was written
+struct OutputRange {
+    OutputRange(std::shared_ptr<OutputFile> file, std::uint64_t offset, std::uint64_t size, bool record):
+        file(std::move(file)), offset(offset), size(size), record(record) { }
+
+    ~OutputRange() {
+        if (!this->failed && this->record)
+            this->file->manifest.add_range(this->file->path, this->file->size, this->file->host_offset, this->offset, this->size);
+    }
+
+    void fail_at(std::uint64_t offset) {
+        this->failed = true;
+        this->file->fail_at(offset);
+    }
+
+    std::shared_ptr<OutputFile> file;
+    std::uint64_t offset, size;
+    bool record;
+    std::atomic_bool failed = false;
+};
+
+struct Chunk {
+    std::shared_ptr<OutputRange> range;
+    std::uint64_t                offset;
+    io::Buffer                   data;
+};
+
+// Checks that the end of a range previously written matches the source, in case it didn't reach the disk
+bool verify_tail(const fs::path &dest, const File &src, std::uint64_t offset, std::uint64_t size) {
+    constexpr std::uint64_t tail_size = 0x10000;
+    auto len = std::min(tail_size, size), pos = offset + size - len;
+
+    auto *fp = std::fopen(PATHSTR(dest).c_str(), "rb");
+    if (!fp)
+        return false;
+    FNX_SCOPEGUARD([fp] { std::fclose(fp); });
+
+    auto written = io::BufferPool::acquire(len), expected = io::BufferPool::acquire(len);
+#ifdef __MINGW32__
+    if (_fseeki64(fp, pos, SEEK_SET) || (std::fread(written.data(), 1, len, fp) != len))
+#else
+    if (std::fseek(fp, pos, SEEK_SET) || (std::fread(written.data(), 1, len, fp) != len))
+#endif
+        return false;
+    if (src.open()->read_at(pos, expected.data(), len) != len)
+        return false;
+    return std::equal(written.begin(), written.end(), expected.begin());
+}
+
+void write_chunk(Chunk &chunk) {
+    auto &file = *chunk.range->file;
+    if (!(file.sparse ? file.write_sparse_at(chunk.offset, chunk.data.data(), chunk.data.size()) :
+            file.write_at(chunk.offset, chunk.data.data(), chunk.data.size()))) {
+        std::perror("Failed to write chunk");
+        chunk.range->fail_at(chunk.offset);
+    }
+}
+
+// Writes chunks on a dedicated thread, so that reading and decrypting the following ones overlaps with disk writes
+// The number of buffers in flight is bounded, which stalls the readers when the disk can't keep up
+// Chunks are handed to the sink in the order they were pushed
+class ChunkWriter {
+    public:
+        using Sink = std::function<void(Chunk &)>;
+
+    public:
+        ChunkWriter(std::size_t max_buffers, Sink sink = write_chunk):
+            max_buffers(max_buffers), sink(std::move(sink)), thread(&ChunkWriter::thread_func, this) { }
+
+        // Waits for all queued chunks to be written
+        ~ChunkWriter() {
+            {
+                std::scoped_lock lk(this->mtx);
+                this->is_exiting = true;
+            }
+            this->ready_cv.notify_one();
+            this->thread.join();
+        }
+
+        // Blocks while the maximum number of buffers is in flight
+        io::Buffer get_buffer() {
+            {
+                std::unique_lock lk(this->mtx);
+                this->free_cv.wait(lk, [this] { return this->num_buffers < this->max_buffers; });
+                ++this->num_buffers;
+            }
+            return io::BufferPool::acquire(chunk_size);
+        }
+
+        void put_buffer(io::Buffer &&buf) {
+            buf = io::Buffer(); // Returned to the pool
+            {
+                std::scoped_lock lk(this->mtx);
+                --this->num_buffers;
+            }
+            this->free_cv.notify_one();
+        }
+
+        void push(Chunk &&chunk) {
+            {
+                std::scoped_lock lk(this->mtx);
+                this->chunks.push_back(std::move(chunk));
+            }
+            this->ready_cv.notify_one();
+        }
+
+    private:
+        void thread_func() {
+            while (true) {
+                std::unique_lock lk(this->mtx);
+                this->ready_cv.wait(lk, [this] { return this->is_exiting || !this->chunks.empty(); });
+                if (this->chunks.empty())
+                    return;
+
+                auto chunk = std::move(this->chunks.front());
+                this->chunks.pop_front();
+                lk.unlock();
+
+                this->sink(chunk);
+                chunk.range.reset();
+                this->put_buffer(std::move(chunk.data));
+            }
+        }
+
+    private:
+        std::mutex              mtx;
+        std::condition_variable free_cv, ready_cv;
+        bool                    is_exiting = false;
+
+        std::size_t max_buffers, num_buffers = 0;
+        std::deque<Chunk> chunks;
+        Sink sink;
+
+        std::thread thread;
+};
+
+// Tar archives are made of 512-byte blocks, each entry being a header followed by the padded content
+constexpr std::size_t   tar_block     = 0x200;
+constexpr std::uint64_t max_ustar_size = 077777777777;
+
+struct UstarHeader {
+    char name[100], mode[8], uid[8], gid[8], size[12], mtime[12], chksum[8], typeflag, linkname[100];
+    char magic[6], version[2], uname[32], gname[32], devmajor[8], devminor[8], prefix[155], pad[12];
+};
+static_assert(sizeof(UstarHeader) == tar_block);
+
+// Appends the header of an entry, preceded by a pax extended header holding the values which don't fit in the ustar fields
+void append_tar_header(io::Buffer &buf, const std::string &name, std::uint64_t size, char type, std::uint64_t mtime) {
+    auto append_block = [&buf](const std::string_view &name, std::uint64_t size, char type, std::uint64_t mtime) {
+        auto pos = buf.size();
+        buf.resize(pos + tar_block);
+
+        UstarHeader hdr = {};
+        std::memcpy(hdr.name, name.data(), std::min(name.size(), sizeof(hdr.name)));
+        std::snprintf(hdr.mode,  sizeof(hdr.mode),  "%07o", (type == '5') ? 0755 : 0644);
+        std::snprintf(hdr.uid,   sizeof(hdr.uid),   "%07o", 0);
+        std::snprintf(hdr.gid,   sizeof(hdr.gid),   "%07o", 0);
+        std::snprintf(hdr.size,  sizeof(hdr.size),  "%011" PRIo64, (size <= max_ustar_size) ? size : 0);
+        std::snprintf(hdr.mtime, sizeof(hdr.mtime), "%011" PRIo64, mtime);
+        hdr.typeflag = type;
+        std::memcpy(hdr.magic,   "ustar", sizeof(hdr.magic));
+        std::memcpy(hdr.version, "00",    sizeof(hdr.version));
+
+        // The checksum is computed with its own field filled with spaces
+        std::memset(hdr.chksum, ' ', sizeof(hdr.chksum));
+        auto *bytes = reinterpret_cast<const std::uint8_t *>(&hdr);
+        std::snprintf(hdr.chksum, sizeof(hdr.chksum), "%06o", std::accumulate(bytes, bytes + sizeof(hdr), 0u));
+
+        std::memcpy(buf.data() + pos, &hdr, sizeof(hdr));
+    };
+
+    std::string records;
+    auto add_record = [&records](const std::string_view &key, const std::string_view &value) {
+        // Records are prefixed with their length, which counts its own digits
+        auto len = key.size() + value.size() + 3;
+        auto digits = std::to_string(len).size();
+        while (std::to_string(len + digits).size() != digits)
+            ++digits;
+        records += std::to_string(len + digits) + ' ';
+        records.append(key).append("=").append(value).append("\n");
+    };
+
+    if (name.size() > sizeof(UstarHeader::name))
+        add_record("path", name);
+    if (size > max_ustar_size)
+        add_record("size", std::to_string(size));
+
+    if (!records.empty()) {
+        append_block("PaxHeaders/" + name.substr(name.find_last_of('/', name.size() - 2) + 1), records.size(), 'x', mtime);
+        auto pos = buf.size();
+        buf.resize(pos + utils::align_up(records.size(), tar_block));
+        std::fill(std::copy(records.begin(), records.end(), buf.begin() + pos), buf.end(), 0);
+    }
+
+    append_block(name, size, type, mtime);
+}
+
+using PlannedFile = std::pair<std::string, std::shared_ptr<File>>;
+
+// Orders files as they are laid out in the container, so that it is read in a forward sweep
+// Files of a nested container come after the raw container, and read its region again
+void plan_sweep(std::vector<PlannedFile> &planned) {
+    std::stable_sort(planned.begin(), planned.end(), [](const PlannedFile &lhs, const PlannedFile &rhs) {
+        return lhs.second->get_host_offset() < rhs.second->get_host_offset();
+    });
+}
+
+// Visits the selected paths, folders being walked down to the requested depth
+// The folder containing a selected file is visited without its node
+template <typename FolderVisitor, typename FileVisitor>
+bool walk_paths(FileSystem &filesys, const fs::path &container, const DumpContext::Options &options,
+        FolderVisitor &&visit_folder, FileVisitor &&visit_file) {
+    for (auto &path: options.paths) {
+        auto norm_path = FileSystem::normalize_path(PATHSTR(path));
+        if (auto opt = filesys.find_folder(path); opt) {
+            if (visit_folder(norm_path, *opt) || filesys.walk(path, options.depth, visit_folder, visit_file))
+                return true;
+        } else if (auto opt = filesys.get_file(norm_path); opt) {
+            if (visit_folder(FileSystem::normalize_path(PATHSTR(path.parent_path())), nullptr) || visit_file(norm_path, *opt))
+                return true;
+        } else {
+            std::fprintf(stderr, "Could not find path \"%s\" inside container \"%s\"\n",
+                PATHSTR(path).c_str(), PATHSTR(container).c_str());
+        }
+    }
+    return false;
+}
+
 } // namespace
 
 int DumpContext::run(const Options &options) {
+    if (options.format == "tar")
+        return this->run_tar(options);
+
+    if (this->dest == "-") {
+        std::fprintf(stderr, "Only tar archives can be written to the standard output\n");
+        return 1;
+    }
+
+    // Files are hashed as they are read, which needs their whole plaintext in order:
+    // they are then dumped as a single range, and without kernel copies
+    auto wants_digest = [&options](std::string_view algo) {
+        return std::find(options.checksums.begin(), options.checksums.end(), algo) != options.checksums.end();
+    };
+    bool hash_sha256 = wants_digest("sha256"), hash_crc32 = wants_digest("crc32"), hashing = hash_sha256 || hash_crc32;
+
+    // Digests are kept in the manifest, which is otherwise removed once the dump completed
+    Manifest manifest(dest / Manifest::name, options.resume, hashing);
+
+    // Each reader (the workers and the waiting thread) can have a chunk being filled and another being decrypted,
+    // with one more queued, so that it never waits on a write in progress
+    ChunkWriter writer(3 * (options.jobs + 1));
+
+    // Chunk buffers are large and long-lived, which makes them a good fit for huge pages
+    io::BufferPool::set_use_hugepages(true);
+    set_scheduler_workers(options.jobs);
+    TaskGroup group;
+
+    // Reads a range of the file through its own storage chain, so that ranges can be processed concurrently
+    auto dump_range = [&writer, hashing](const std::shared_ptr<OutputRange> &range, const File &src) {
+        auto &out = *range->file;
+        auto base = src.open();
+        TaskGroup decoder;
+        bool try_copy = !hashing;
+        for (auto offset = range->offset, end = range->offset + range->size; offset < end;) {
+            // Plaintext data is copied by the kernel, without going through user space
+            if (auto extent = try_copy ? src.get_extent(offset, end - offset) : std::nullopt; extent) {
+                auto copied = out.copy_at(offset, *extent);
+                offset  += copied;
+                try_copy = copied && (copied == extent->size);
+                continue;
+            }
+
+            auto buf = writer.get_buffer();
+            base->seek(offset);
+            buf.resize(base->read_encoded(buf.data(), std::min(chunk_size, end - offset)));
+            if (buf.empty()) {
+                writer.put_buffer(std::move(buf));
+                range->fail_at(offset);
+                break;
+            }
+
+            // The chunk is decrypted by another worker while the next one is read,
+            // waiting on the previous one keeps the hashes in order
+            auto buf_size = buf.size();
+            decoder.wait();
+            decoder.run([&writer, &base, &out, range, offset, buf = std::move(buf)]() mutable {
+                base->decode(buf.data(), buf.size(), offset);
+                out.hash(buf.data(), buf.size());
+                writer.push({ range, offset, std::move(buf) });
+            });
+            offset += buf_size;
+        }
+    };
+
     std::mutex stdout_mtx;
-    auto worker = [&](const fs::path &path) {
-        auto dest_file = dest + path;
+    auto print = [&stdout_mtx](const char *action, const fs::path &path) {
+        std::scoped_lock lk(stdout_mtx);
+        std::printf("%s \"%s\"\n", action, PATHSTR(path).c_str());
+    };
+
+    // Files completed by a previous dump are hashed again if it didn't record the requested digests
+    auto has_digest = [](const Manifest::Entry &entry, std::string_view algo) {
+        return std::find(entry.digests.begin(), entry.digests.end(), algo) != entry.digests.end();
+    };
+
+    using Item = PlannedFile;
+
+    // Opens the destination of a file, or returns nullptr if a previous dump completed it or it can't be opened
+    // Ranges recorded for a partial file are returned through done
+    auto open_output = [&](const Item &item, const Manifest::Entry *&done) -> std::shared_ptr<OutputFile> {
+        auto &[path, src] = item;
+        auto dest_file   = dest + path;
+        auto size        = src->get_size();
+        auto host_offset = src->get_host_offset();
+
+        // Files recorded as complete are skipped
+        std::error_code ec;
+        done = options.resume ? manifest.find(path, size, host_offset) : nullptr;
+        if (done && (fs::file_size(dest_file, ec) != size))
+            done = nullptr;
+        if (done && done->complete && !(hash_sha256 && !has_digest(*done, "sha256")) && !(hash_crc32 && !has_digest(*done, "crc32"))) {
+            print("Skipping", dest_file);
+            return nullptr;
+        }
+
+        print(done ? "Resuming" : "Dumping", dest_file);
 
-        std::unique_lock lk(stdout_mtx);
-        std::printf("Dumping \"%s\"\n", PATHSTR(dest_file).c_str());
-        lk.unlock();
+        auto *fp = std::fopen(PATHSTR(dest_file).c_str(), done ? "r+b" : "wb");
+        if (!fp) {
+            manifest.set_incomplete();
+            return nullptr;
+        }
 
-        auto src = *this->filesys->get_file(FileSystem::normalize_path(PATHSTR(path)));
-        auto *fp = std::fopen(PATHSTR(dest_file).c_str(), "wb");
-        if (!fp)
+        auto out = std::make_shared<OutputFile>(fp, manifest, path, size, host_offset, options.sparse, done);
+        if (options.sparse) {
+            if (!out->truncate(size))
+                out->failed = true;
+        } else if (!done) {
+            out->preallocate(size);
+        }
+        if (hash_sha256)
+            out->sha256.emplace();
+        if (hash_crc32)
+            out->crc32.emplace();
+        return out;
+    };
+
+    // Recorded ranges are kept if their end checks out, unless the whole content is hashed again
+    auto range_done = [&](const Manifest::Entry *done, const Item &item, std::uint64_t offset, std::uint64_t length) {
+        return done && !hashing && std::any_of(done->ranges.begin(), done->ranges.end(), [&](auto &r) {
+            return (r == std::pair(offset, length)) && verify_tail(dest + item.first, *item.second, offset, length);
+        });
+    };
+
+    // Large files are split in ranges, so that a single huge entry can use every worker
+    auto count_ranges = [](std::uint64_t size) {
+        return std::max(utils::align_up(size, range_size) / range_size, std::uint64_t(1));
+    };
+
+    auto worker = [&](const Item &item) {
+        const Manifest::Entry *done;
+        auto out = open_output(item, done);
+        if (!out)
             return;
 
-        std::size_t read = 0;
-        std::vector<std::uint8_t> buf(0x400000); // 4MiB
-        for (std::size_t offset = 0; offset < src->get_size(); offset += read) {
-            read = src->read(buf.data(), buf.size(), offset);
-            std::fwrite(buf.data(), read, 1, fp);
+        // Ranges of a hashed file would be processed concurrently, it is dumped as a single one
+        auto size = item.second->get_size(), num_ranges = hashing ? 1 : count_ranges(size);
+        for (std::uint64_t i = 0; i < num_ranges; ++i) {
+            auto offset = i * range_size, length = (num_ranges == 1) ? size : std::min(range_size, size - offset);
+            if (range_done(done, item, offset, length))
+                continue;
+
+            auto range = std::make_shared<OutputRange>(out, offset, length, num_ranges > 1);
+            if (i == num_ranges - 1)
+                dump_range(range, *item.second);
+            else
+                group.run([&dump_range, range = std::move(range), src = item.second] { dump_range(range, *src); });
         }
+    };
+
+    // Dumps the files one range at a time, in the order of their data in the container
+    // Ranges of a nested container's files follow the range of the raw container holding them, so that their data is read
+    // again while it is still cached, and the container is read in a single pass
+    auto linear_worker = [&](const std::vector<Item> &planned) {
+        struct Piece {
+            std::size_t   item;
+            std::uint64_t offset, length, host_offset;
+        };
 
-        std::fclose(fp);
+        std::vector<Piece> pieces;
+        std::vector<std::size_t> remaining(planned.size());
+        for (std::size_t i = 0; i < planned.size(); ++i) {
+            auto &src = *planned[i].second;
+            auto size = src.get_size();
+            remaining[i] = count_ranges(size);
+            for (std::uint64_t offset = 0; offset < std::max(size, std::uint64_t(1)); offset += range_size)
+                pieces.push_back({ i, offset, std::min(range_size, size - offset), src.get_host_offset() + offset });
+        }
+
+        std::stable_sort(pieces.begin(), pieces.end(), [](const Piece &lhs, const Piece &rhs) {
+            return lhs.host_offset < rhs.host_offset;
+        });
+
+        // Destinations are opened at their first range, and closed after their last one
+        std::vector<std::shared_ptr<OutputFile>> outputs(planned.size());
+        std::vector<const Manifest::Entry *> dones(planned.size());
+        std::vector<bool> opened(planned.size());
+        for (auto &piece: pieces) {
+            auto &item = planned[piece.item];
+            if (!opened[piece.item]) {
+                outputs[piece.item] = open_output(item, dones[piece.item]);
+                opened[piece.item]  = true;
+            }
+
+            auto record = count_ranges(item.second->get_size()) > 1;
+            if (auto &out = outputs[piece.item]; out && !range_done(dones[piece.item], item, piece.offset, piece.length))
+                dump_range(std::make_shared<OutputRange>(out, piece.offset, piece.length, record), *item.second);
+
+            if (--remaining[piece.item] == 0)
+                outputs[piece.item].reset();
+        }
     };
 
-    auto pool = ThreadPool<fs::path>(worker);
-    pool.start_workers(options.jobs);
+    // Tasks reference the above, make sure they completed before returning
+    FNX_SCOPEGUARD([&group] { group.join(); });
 
-    auto callback_folder = [&](const fs::path &path) -> bool {
+    auto callback_folder = [&](const std::string &path, const std::shared_ptr<Folder> &) -> bool {
         std::error_code rc;
         fs::create_directories(dest + path, rc);
         return static_cast<bool>(rc);
     };
 
-    auto callback_file = [&](const fs::path &path) -> bool {
-        pool.queue_item(path);
+    std::vector<Item> planned;
+    auto callback_file = [&](const std::string &path, const std::shared_ptr<File> &file) -> bool {
+        if (options.linear)
+            planned.emplace_back(path, file);
+        else
+            group.run([&worker, item = Item(path, file)] { worker(item); });
         return false;
     };
 
-    for (auto &path: options.paths) {
-        if (auto opt = this->filesys->find_folder(path); opt) {
-            if (callback_folder(path) || this->filesys->walk(path, options.depth, callback_folder, callback_file))
-                return 1;
-        } else if (auto opt = this->filesys->get_file(FileSystem::normalize_path(PATHSTR(path))); opt) {
-            if (callback_folder(path.parent_path()) || callback_file(path))
-                return 1;
-        } else {
-            std::fprintf(stderr, "Could not find path \"%s\" inside container \"%s\"\n",
-                PATHSTR(path).c_str(), PATHSTR(container).c_str());
-        }
+    if (walk_paths(*this->filesys, this->container, options, callback_folder, callback_file)) {
+        manifest.set_incomplete();
+        return 1;
+    }
+
+    if (options.linear) {
+        this->filesys->advise_sequential();
+        linear_worker(planned);
     }
 
-    pool.wait();
+    group.wait();
     return 0;
 }
 
+int DumpContext::run_tar(const Options &options) {
+    if (this->dest != "-") {
+        std::fprintf(stderr, "Tar archives are written to the standard output, use \"-\" as destination\n");
+        return 1;
+    }
+
+#ifdef __MINGW32__
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // Written in order by the writer thread, while the following data is read and decrypted
+    std::atomic_bool failed = false;
+    auto writer_ptr = std::make_unique<ChunkWriter>(3, [&failed](Chunk &chunk) {
+        if (!failed && (std::fwrite(chunk.data.data(), 1, chunk.data.size(), stdout) != chunk.data.size())) {
+            std::perror("Failed to write archive");
+            failed = true;
+        }
+    });
+    auto &writer = *writer_ptr;
+
+    auto mtime = static_cast<std::uint64_t>(std::time(nullptr));
+
+    // Padding of the previous entry is emitted along with the next header
+    std::size_t padding = 0;
+    auto push_header = [&](const std::string &name, std::uint64_t size, char type) {
+        auto buf = writer.get_buffer();
+        buf.resize(padding);
+        std::fill(buf.begin(), buf.end(), 0);
+        append_tar_header(buf, name, size, type, mtime);
+        writer.push({ nullptr, 0, std::move(buf) });
+        padding = utils::align_up(size, tar_block) - size;
+    };
+
+    // Folders are emitted as they are visited, which puts them before their content
+    auto callback_folder = [&](const std::string &path, const std::shared_ptr<Folder> &) -> bool {
+        if (path != "/")
+            push_header(path.substr(1) + '/', 0, '5');
+        return failed;
+    };
+
+    std::vector<PlannedFile> planned;
+    auto callback_file = [&](const std::string &path, const std::shared_ptr<File> &file) -> bool {
+        planned.emplace_back(path, file);
+        return false;
+    };
+
+    if (walk_paths(*this->filesys, this->container, options, callback_folder, callback_file))
+        return 1;
+
+    plan_sweep(planned);
+    this->filesys->advise_sequential();
+
+    int rc = 0;
+    for (auto &[path, src]: planned) {
+        auto size = src->get_size();
+        push_header(path.substr(1), size, '0');
+
+        auto base = src->open();
+        for (std::uint64_t offset = 0; (offset < size) && !failed;) {
+            auto buf = writer.get_buffer();
+            auto len = std::min(chunk_size, size - offset);
+            buf.resize(base->read_at(offset, buf.data(), len));
+
+            // The header already announced the size, pad the entry to keep the archive readable
+            if (buf.size() != len) {
+                std::fprintf(stderr, "Failed to read \"%s\"\n", path.c_str());
+                std::fill(buf.begin() + buf.size(), buf.begin() + len, 0);
+                buf.resize(len);
+                rc = 1;
+            }
+
+            writer.push({ nullptr, offset, std::move(buf) });
+            offset += len;
+        }
+    }
+
+    // The archive ends with two zero-filled blocks, after the padding of the last entry
+    auto buf = writer.get_buffer();
+    buf.resize(padding + 2 * tar_block);
+    std::fill(buf.begin(), buf.end(), 0);
+    writer.push({ nullptr, 0, std::move(buf) });
+
+    // Waits for the queued chunks to be written
+    writer_ptr.reset();
+    if (std::fflush(stdout))
+        failed = true;
+    return (rc || failed) ? 1 : 0;
+}
+
 } // namespace fnx
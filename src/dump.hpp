@@ -18,6 +18,7 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
 #include <vector>
 
 #include "context.hpp"
@@ -29,6 +30,11 @@ class DumpContext final: public Context {
         struct Options {
             std::size_t                        depth = -1;
             std::size_t                        jobs  =  1;
+            bool                               linear = false;
+            bool                               resume = false;
+            bool                               sparse = false;
+            std::vector<std::string>           checksums;
+            std::string                        format = "dir";
             std::vector<std::filesystem::path> paths;
         };
 
@@ -39,6 +45,9 @@ class DumpContext final: public Context {
         }
         int run(const Options &options);
 
+    private:
+        int run_tar(const Options &options);
+
     private:
         std::filesystem::path dest;
 };
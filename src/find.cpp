@@ -15,15 +15,23 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <functional>
-#include <re2/re2.h>
 
-#ifdef __MINGW32__
-#   include <shlwapi.h>
-#else
-#   include <fnmatch.h>
-#endif
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <variant>
+#include <vector>
 
+#include "matcher.hpp"
+#include "thread_pool.hpp"
 #include "vfs.hpp"
 #include "utils.hpp"
 
@@ -31,50 +39,168 @@
 
 namespace fnx {
 
+namespace {
+
+// Conditions on the attributes of nodes, answered from the parsed metadata without reading any data
+// They are checked from the cheapest to the most expensive, stopping at the first one which doesn't hold
+class Predicates {
+    public:
+        bool parse(const FindContext::Options &options) {
+            this->type           = options.type;
+            this->container_kind = options.container_kind;
+            this->content_type   = options.content_type;
+            return options.size.empty() || this->parse_size(options.size);
+        }
+
+        bool empty() const {
+            return this->type.empty() && !this->size_op && this->container_kind.empty() && this->content_type.empty();
+        }
+
+        bool operator ()(const FileSystem &filesys, const std::string &path, const Folder &node, const Folder &parent) const {
+            FNX_UNUSED(filesys, path);
+            if ((!this->type.empty() && (this->type != "d")) || this->size_op || !this->in_container(parent))
+                return false;
+            return this->content_type.empty() || (node.has_container() && (node.get_content_type() == this->content_type));
+        }
+
+        bool operator ()(const FileSystem &filesys, const std::string &path, const File &node, const Folder &parent) const {
+            if ((!this->type.empty() && (this->type != "f")) || !this->has_size(node.get_size()) || !this->in_container(parent))
+                return false;
+            if (this->content_type.empty())
+                return true;
+
+            // Raw container files are matched through the folder they were expanded to, which is named after them
+            auto name_pos = path.find_last_of('/') + 1, ext_pos = path.find_last_of('.');
+            auto opt = filesys.get_folder(path.substr(0, ((ext_pos != std::string::npos) && (ext_pos >= name_pos)) ? ext_pos : path.size()));
+            return opt && (*opt)->has_container() && ((*opt)->get_content_type() == this->content_type);
+        }
+
+    private:
+        // Accepts N, +N (more than) or -N (less than), with an optional binary unit suffix
+        bool parse_size(const std::string &str) {
+            auto *ptr = str.c_str();
+            if ((*ptr == '+') || (*ptr == '-'))
+                this->size_op = *ptr++;
+            else
+                this->size_op = '=';
+
+            // strtoull would accept another sign, and a base prefix
+            if (!std::isdigit(static_cast<unsigned char>(*ptr)))
+                return false;
+
+            char *end;
+            errno = 0;
+            this->size_value = std::strtoull(ptr, &end, 10);
+            if (errno == ERANGE)
+                return false;
+
+            constexpr std::string_view units = "KMGT";
+            if (auto pos = units.find(std::toupper(*end)); *end && (pos != std::string_view::npos)) {
+                auto shift = 10 * (pos + 1);
+                if (this->size_value > (std::numeric_limits<std::uint64_t>::max() >> shift))
+                    return false;
+                this->size_value <<= shift, ++end;
+            }
+            return !*end;
+        }
+
+        bool has_size(std::uint64_t size) const {
+            switch (this->size_op) {
+                case '+':
+                    return size > this->size_value;
+                case '-':
+                    return size < this->size_value;
+                case '=':
+                    return size == this->size_value;
+                default:
+                    return true;
+            }
+        }
+
+        bool in_container(const Folder &parent) const {
+            return this->container_kind.empty() || (parent.has_container() && (parent.get_container_name() == this->container_kind));
+        }
+
+    private:
+        std::string   type, container_kind, content_type;
+        char          size_op    = 0;
+        std::uint64_t size_value = 0;
+};
+
+// Matches in a subtree, in the order of a sequential walk
+// Subtrees of child folders are searched concurrently, and filled in place once done
+struct Matches {
+    std::vector<std::variant<std::string, std::shared_ptr<Matches>>> entries;
+
+    // Returns false once the maximum count was reached
+    bool print(std::size_t &budget) const {
+        for (auto &entry: this->entries) {
+            if (auto *match = std::get_if<std::string>(&entry); match) {
+                if (!budget)
+                    return false;
+                std::fwrite(match->data(), 1, match->size(), stdout);
+                --budget;
+            } else if (!std::get<std::shared_ptr<Matches>>(entry)->print(budget)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
 int FindContext::run(const Options &options) {
     if (!options.max_count)
         return 0;
 
-    std::size_t cur_count = 0;
-    std::string format = options.null_terminator ? "%s" : "%s\n";
-
-    std::unique_ptr<RE2> regex;
-    std::function<bool(const std::filesystem::path &)> callback;
-    if (options.is_regex) {
-        RE2::Options opts(RE2::Quiet);
-        opts.set_case_sensitive(!options.case_insensitive);
-        opts.set_never_capture(true);
-        regex = std::make_unique<RE2>(this->pattern, opts);
-        if (!regex->ok()) {
-            std::fprintf(stderr, "Failed to compile regex: %s\n", regex->error().c_str());
+    auto patterns = this->patterns;
+    if (!options.patterns_file.empty()) {
+        auto *fp = std::fopen(PATHSTR(options.patterns_file).c_str(), "r");
+        if (!fp) {
+            std::fprintf(stderr, "Failed to open pattern file \"%s\"\n", PATHSTR(options.patterns_file).c_str());
             return 1;
         }
+        FNX_SCOPEGUARD([fp] { std::fclose(fp); });
 
-        callback = [&](const std::filesystem::path &path) -> bool {
-            if (RE2::FullMatch(path.filename().string(), *regex)) {
-                std::printf(format.c_str(), FileSystem::normalize_path(PATHSTR(path)).c_str());
-                if (options.null_terminator)
-                    std::putchar(0);
-                ++cur_count;
-            }
-            return cur_count >= options.max_count;
-        };
-    } else {
-        callback = [&, this](const std::filesystem::path &path) -> bool {
-#ifdef __MINGW32__
-            if (PathMatchSpecA(path.filename().string().c_str(), this->pattern.c_str())) {
-#else
-            if (fnmatch(this->pattern.c_str(), path.filename().c_str(), options.case_insensitive ? FNM_CASEFOLD : 0) == 0) {
-#endif
-                std::printf(format.c_str(), FileSystem::normalize_path(PATHSTR(path)).c_str());
-                if (options.null_terminator)
-                    std::putchar(0);
-                ++cur_count;
-            }
-            return cur_count >= options.max_count;
-        };
+        std::array<char, 0x1000> line;
+        while (std::fgets(line.data(), line.size(), fp)) {
+            std::string_view pattern(line.data());
+            while (pattern.ends_with('\n') || pattern.ends_with('\r'))
+                pattern.remove_suffix(1);
+            if (!pattern.empty())
+                patterns.emplace_back(pattern);
+        }
     }
 
+    Predicates predicates;
+    if (!predicates.parse(options)) {
+        std::fprintf(stderr, "Invalid size \"%s\"\n", options.size.c_str());
+        return 1;
+    }
+
+    // Without any expression, nodes are only selected by their attributes
+    if (patterns.empty() && predicates.empty()) {
+        std::fprintf(stderr, "No expression to match\n");
+        return 1;
+    }
+
+    NameFilter filter(patterns, options.is_regex, options.case_insensitive);
+    if (!filter.get_error().empty()) {
+        std::fprintf(stderr, "%s\n", filter.get_error().c_str());
+        return 1;
+    }
+
+    auto &filesys = *this->filesys;
+    auto matches = [&](const std::string &path, const auto &node, const Folder &parent) -> bool {
+        return predicates(filesys, path, *node, parent) && (patterns.empty() || filter.matches(node->get_name()));
+    };
+
+    char terminator = options.null_terminator ? '\0' : '\n';
+
+    // The scheduler is created by the first folder expansion
+    set_scheduler_workers(options.jobs);
+
     auto opt = this->filesys->find_folder(options.start);
     if (!opt) {
         std::fprintf(stderr, "Could not find path \"%s\" inside container \"%s\"\n",
@@ -82,7 +208,85 @@ int FindContext::run(const Options &options) {
         return 1;
     }
 
-    this->filesys->walk(options.start, options.depth, callback, callback);
+    // Ordered parallel searches buffer matches until the whole tree was searched,
+    // so a search limited in matches is faster done sequentially, stopping at the last one
+    bool limited = options.max_count != static_cast<std::size_t>(-1);
+    if ((options.jobs <= 1) || (limited && !options.unordered)) {
+        std::size_t cur_count = 0;
+        auto callback = [&](const std::string &path, const auto &node, const Folder &parent) -> bool {
+            if (matches(path, node, parent)) {
+                std::fputs(path.c_str(), stdout);
+                std::putchar(terminator);
+                ++cur_count;
+            }
+            return cur_count >= options.max_count;
+        };
+
+        this->filesys->walk(options.start, options.depth, callback, callback);
+        return 0;
+    }
+
+    // Each folder is searched by a task, which spawns one for each of its child folders
+    // Unordered matches are printed when a folder was searched, ordered ones when the whole tree was
+    TaskGroup group;
+
+    std::mutex stdout_mtx;
+    std::atomic_size_t cur_count = 0;
+    auto search = [&](auto &self, const std::string &location, std::size_t depth, Matches *results) -> void {
+        // Like walk, a null depth visits nothing
+        if (!depth || (options.unordered && (cur_count >= options.max_count)))
+            return;
+
+        std::string unordered;
+        auto record = [&](const std::string &path, const auto &node, const Folder &parent) -> bool {
+            if (!matches(path, node, parent))
+                return false;
+
+            if (results) {
+                results->entries.emplace_back(path + terminator);
+                return false;
+            }
+
+            if (cur_count++ >= options.max_count)
+                return true;
+            unordered.append(path).append(1, terminator);
+            return false;
+        };
+
+        auto visit_folder = [&](const std::string &path, const std::shared_ptr<Folder> &folder, const Folder &parent) -> bool {
+            if (record(path, folder, parent))
+                return true;
+            if (depth > 1) {
+                auto sub = results ? std::make_shared<Matches>() : nullptr;
+                if (sub)
+                    results->entries.emplace_back(sub);
+                group.run([&self, path = path, depth, sub] {
+                    self(self, path, depth - 1, sub.get());
+                });
+            }
+            return false;
+        };
+
+        auto visit_file = [&](const std::string &path, const std::shared_ptr<File> &file, const Folder &parent) -> bool {
+            return record(path, file, parent);
+        };
+
+        // Expands the folder, its children are only expanded by their own task
+        this->filesys->process_dir(location);
+        this->filesys->walk(location, 1, visit_folder, visit_file);
+
+        if (!unordered.empty()) {
+            std::scoped_lock lk(stdout_mtx);
+            std::fwrite(unordered.data(), 1, unordered.size(), stdout);
+        }
+    };
+
+    Matches results;
+    search(search, FileSystem::normalize_path(PATHSTR(options.start)), options.depth, options.unordered ? nullptr : &results);
+    group.wait();
+
+    auto budget = options.max_count;
+    results.print(budget);
     return 0;
 }
 
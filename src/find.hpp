@@ -19,6 +19,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 #include "context.hpp"
 
@@ -28,22 +29,29 @@ class FindContext final: public Context {
     public:
         struct Options {
             std::filesystem::path start            = "/";
+            std::filesystem::path patterns_file;
             std::size_t           max_count        = -1;
             std::size_t           depth            = -1;
+            std::size_t           jobs             =  1;
+            std::string           size;
+            std::string           type;
+            std::string           container_kind;
+            std::string           content_type;
             bool                  is_regex         = false;
             bool                  case_insensitive = false;
             bool                  null_terminator  = false;
+            bool                  unordered        = false;
         };
 
     public:
-        FindContext(const std::filesystem::path &container, const std::string &pattern):
-                Context(container), pattern(pattern) {
+        FindContext(const std::filesystem::path &container, const std::vector<std::string> &patterns):
+                Context(container), patterns(patterns) {
             this->filesys->set_keep_raw(true);
         }
         int run(const Options &options);
 
     private:
-        std::string pattern;
+        std::vector<std::string> patterns;
 };
 
 } // namespace fnx
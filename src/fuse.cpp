@@ -15,13 +15,22 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <string>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#ifndef __MINGW32__
+#   include <sys/resource.h>
+#endif
+
 #include "utils.hpp"
 
 #include "fuse.hpp"
@@ -30,12 +39,37 @@ namespace fnx {
 
 namespace {
 
-FileSystem *s_fs;
+FuseContext *s_ctx;
+
+// Descriptors left to FUSE and the standard library when budgeting host files
+constexpr std::size_t reserved_fds = 32;
 
 FileSystem &get_fs() {
     return *reinterpret_cast<FileSystem *>(fuse_get_context()->private_data);
 }
 
+// State of an open file, which keeps it readable even if its container gets unloaded from the tree
+struct FileHandle {
+    std::shared_ptr<File>         file;
+    std::unique_ptr<io::FileBase> base; // Private storage chain, so that handles don't share a read position
+    std::mutex                    mtx;
+};
+
+FileHandle &get_handle(struct fuse_file_info *info) {
+    return *reinterpret_cast<FileHandle *>(info->fh);
+}
+
+// Entries might be looked up before their parent was ever listed, or after it was unloaded,
+// in which case the parent needs processing first
+template <typename F>
+auto lookup(FileSystem &fs, const char *path, F &&getter) {
+    if (auto opt = getter(fs, path); opt)
+        return opt;
+    if (!fs.find_folder(std::filesystem::path(path).parent_path()))
+        return decltype(getter(fs, path))();
+    return getter(fs, path);
+}
+
 } // namespace
 
 FuseContext::FuseContext(const std::filesystem::path &container, std::filesystem::path &mountpoint):
@@ -47,21 +81,47 @@ FuseContext::FuseContext(const std::filesystem::path &container, std::filesystem
 #endif
 }
 
+FuseContext::FuseContext(const std::vector<std::filesystem::path> &containers, std::filesystem::path &mountpoint):
+        Context(containers), mountpoint(mountpoint) {
+#ifndef __MINGW32__
+    std::filesystem::create_directories(this->mountpoint);
+#endif
+}
+
 int FuseContext::run(const Options &options) {
     this->filesys->set_keep_raw(options.raw_containers);
+    this->filesys->set_max_loaded(options.max_loaded);
+    this->filesys->set_max_memory(options.max_memory);
+
+    // Unless given, the budget of host files keeps containers from exhausting the descriptors of the process
+    auto max_files = options.max_files;
+#ifndef __MINGW32__
+    if (struct rlimit lim; (max_files == static_cast<std::size_t>(-1)) && !getrlimit(RLIMIT_NOFILE, &lim) &&
+            (lim.rlim_cur != RLIM_INFINITY) && (lim.rlim_cur > 2 * reserved_fds))
+        max_files = lim.rlim_cur - reserved_fds;
+#endif
+    this->filesys->set_max_files(max_files);
+    this->prefetch_depth = options.prefetch_depth;
+    this->prefetch_jobs  = options.prefetch_jobs;
 
     auto dir = this->filesys->get_folder("/");
-    std::printf("Mounting \"%s\" to \"%s\" as %s\n", PATHSTR(this->container).c_str(),
-        PATHSTR(this->mountpoint).c_str(), (*dir)->get_container_name().data());
+    if (this->filesys->is_library())
+        std::printf("Mounting %zu containers to \"%s\"\n", (*dir)->get_children().size(), PATHSTR(this->mountpoint).c_str());
+    else
+        std::printf("Mounting \"%s\" to \"%s\" as %s\n", PATHSTR(this->container).c_str(),
+            PATHSTR(this->mountpoint).c_str(), (*dir)->get_container_name().data());
 
     this->ops.getattr = FuseContext::wrap_getattr;
     this->ops.readdir = FuseContext::wrap_readdir;
+    this->ops.open    = FuseContext::wrap_open;
     this->ops.read    = FuseContext::wrap_read;
+    this->ops.release = FuseContext::wrap_release;
     this->ops.init    = FuseContext::wrap_init;
 
 #ifdef __MINGW32__
     this->ops.opendir = FuseContext::wrap_opendir;
-    this->ops.open    = FuseContext::wrap_open;
+#else
+    this->ops.read_buf = FuseContext::wrap_read_buf;
 #endif
 
     struct fuse_args args = FUSE_ARGS_INIT(0, nullptr);
@@ -73,55 +133,136 @@ int FuseContext::run(const Options &options) {
     if (!options.background)
         fuse_opt_add_arg(&args, "-f");                      // Foreground
 
-    for (auto &arg: options.fuse_args)
-        fuse_opt_add_arg(&args, ("-o" + arg).c_str());
-
     fuse_opt_add_arg(&args, "-osync_read");                 // Synchronous reads
 
-    s_fs = this->filesys.get();
+#ifndef __MINGW32__
+    // The filesystem is read-only and never changes under the kernel, so entries and attributes can be cached
+    // for long periods. Also report our own inode numbers, assigned per path, so that they are stable across lookups
+    fuse_opt_add_arg(&args, "-ouse_ino,entry_timeout=3600,attr_timeout=3600,negative_timeout=3600");
+#endif
+
+    for (auto &arg: options.fuse_args)                      // Passed last so they can override the defaults
+        fuse_opt_add_arg(&args, ("-o" + arg).c_str());
+
+    s_ctx = this;
     return fuse_main(args.argc, args.argv, &this->ops, nullptr);
 }
 
-int FuseContext::wrap_getattr(const char *path, struct stat *stbuf) {
+FuseContext::~FuseContext() {
+    this->stop_prefetch = true;
+}
+
+void FuseContext::start_prefetch() {
+    if (!this->prefetch_depth)
+        return;
+
+    // The tree is expanded breadth-first, one level at a time
+    this->prefetcher = std::make_unique<TaskGroup>();
+    this->prefetcher->run([this] {
+        std::vector<std::filesystem::path> level = { "/" };
+        for (auto depth = this->prefetch_depth; depth && !level.empty() && !this->stop_prefetch; --depth) {
+            std::vector<std::vector<std::filesystem::path>> next_level(level.size());
+            parallel_for(level.size(), [&, depth](std::size_t i) {
+                if (this->stop_prefetch)
+                    return;
+
+                // Like the FUSE operations, trim after releasing the tree lock, so that prefetching stays within the budget
+                auto &fs = *this->filesys;
+                FNX_SCOPEGUARD([&fs] { fs.trim(); });
+                auto lk  = fs.lock_tree();
+                auto opt = fs.process_dir(level[i]);
+                if (!opt || (depth <= 1))
+                    return;
+
+                for (auto &child: (*opt)->get_children())
+                    next_level[i].push_back(level[i] / child->get_name());
+            }, this->prefetch_jobs);
+
+            level.clear();
+            for (auto &paths: next_level)
+                std::move(paths.begin(), paths.end(), std::back_inserter(level));
+        }
+    });
+}
+
+ino_t FuseContext::get_ino(const std::string &path) {
+    std::scoped_lock lk(this->ino_mtx);
+    if (path == "/")
+        return 1;
+    auto [it, inserted] = this->inodes.try_emplace(path, this->next_ino);
+    if (inserted)
+        ++this->next_ino;
+    return it->second;
+}
+
+void FuseContext::fill_folder_stat(struct stat *stbuf, const std::string &path) {
     auto *ctx = fuse_get_context();
-    auto &fs  = get_fs();
 
     *stbuf = {};
-    stbuf->st_uid = ctx->uid;
-    stbuf->st_gid = ctx->gid;
-
-    if (fs.get_folder(path)) {
-        stbuf->st_mode = S_IFDIR | 0555;
-    } else if (auto opt = fs.get_file(path); opt) {
-        stbuf->st_size = (*opt)->get_size();
-        stbuf->st_mode = S_IFREG | 0444;
-    } else {
+    stbuf->st_ino  = this->get_ino(path);
+    stbuf->st_uid  = ctx->uid;
+    stbuf->st_gid  = ctx->gid;
+    stbuf->st_mode = S_IFDIR | 0555;
+}
+
+void FuseContext::fill_file_stat(struct stat *stbuf, const std::string &path, const File &file) {
+    auto *ctx = fuse_get_context();
+
+    *stbuf = {};
+    stbuf->st_ino  = this->get_ino(path);
+    stbuf->st_uid  = ctx->uid;
+    stbuf->st_gid  = ctx->gid;
+    stbuf->st_mode = S_IFREG | 0444;
+    stbuf->st_size = file.get_size();
+}
+
+int FuseContext::wrap_getattr(const char *path, struct stat *stbuf) {
+    auto &fs = get_fs();
+    FNX_SCOPEGUARD([&fs] { fs.trim(); });
+    auto lk = fs.lock_tree();
+
+    if (auto opt = lookup(fs, path, [](auto &fs, auto *path) { return fs.get_folder(path); }); opt)
+        s_ctx->fill_folder_stat(stbuf, path);
+    else if (auto opt = lookup(fs, path, [](auto &fs, auto *path) { return fs.get_file(path); }); opt)
+        s_ctx->fill_file_stat(stbuf, path, **opt);
+    else
         return -ENOENT;
-    }
 
     return 0;
 }
 
 int FuseContext::wrap_opendir(const char *path, struct fuse_file_info *info) {
     FNX_UNUSED(info);
-    return get_fs().get_folder(path) ? 0 : -ENOENT;
+    auto &fs = get_fs();
+    auto lk = fs.lock_tree();
+    return fs.get_folder(path) ? 0 : -ENOENT;
 }
 
 int FuseContext::wrap_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *info) {
     FNX_UNUSED(offset, info);
     auto &fs = get_fs();
+    FNX_SCOPEGUARD([&fs] { fs.trim(); });
+    auto lk = fs.lock_tree();
 
-    struct stat st = {};
-    if (auto opt = fs.process_dir(std::filesystem::path(path)); opt) {
+    // Pass full attributes with every entry, so that consumers which honor them (eg. WinFsp)
+    // don't need to issue a separate getattr for each one of them
+    struct stat st;
+    if (auto opt = fs.find_folder(std::filesystem::path(path)); opt) {
         auto dir = opt.value();
 
-        st.st_mode = S_IFREG | 0555;
-        for (auto &d: dir->get_children())
+        std::string prefix = path;
+        if (!prefix.ends_with('/'))
+            prefix.push_back('/');
+
+        for (auto &d: dir->get_children()) {
+            s_ctx->fill_folder_stat(&st, prefix + d->get_name());
             filler(buf, d->get_name().c_str(), &st, 0);
+        }
 
-        st.st_mode = S_IFREG | 0444;
-        for (auto &f: dir->get_files())
+        for (auto &f: dir->get_files()) {
+            s_ctx->fill_file_stat(&st, prefix + f->get_name(), *f);
             filler(buf, f->get_name().c_str(), &st, 0);
+        }
     } else {
         return -ENOENT;
     }
@@ -130,24 +271,77 @@ int FuseContext::wrap_readdir(const char *path, void *buf, fuse_fill_dir_t fille
 }
 
 int FuseContext::wrap_open(const char *path, struct fuse_file_info *info) {
-    FNX_UNUSED(info);
-    return get_fs().get_file(path) ? 0 : -ENOENT;
-}
-
-int FuseContext::wrap_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *info) {
     if (info->flags & (O_WRONLY | O_RDWR | O_CREAT | O_EXCL | O_TRUNC | O_APPEND))
         return -EROFS;
 
     auto &fs = get_fs();
-    if (auto opt = fs.get_file(path); opt)
-        return (*opt)->read(buf, size, offset);
+    FNX_SCOPEGUARD([&fs] { fs.trim(); });
+    auto lk = fs.lock_tree();
+
+    auto opt = lookup(fs, path, [](auto &fs, auto *path) { return fs.get_file(path); });
+    if (!opt)
+        return -ENOENT;
 
-    return -ENOENT;
+    auto base = (*opt)->open();
+    info->fh = reinterpret_cast<std::uint64_t>(new FileHandle{ std::move(*opt), std::move(base), {} });
+    return 0;
+}
+
+int FuseContext::wrap_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *info) {
+    FNX_UNUSED(path);
+    auto &handle = get_handle(info);
+
+    std::scoped_lock lk(handle.mtx);
+    return handle.base->read_at(offset, buf, size);
+}
+
+int FuseContext::wrap_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *info) {
+    FNX_UNUSED(path);
+    auto &handle = get_handle(info);
+
+    // Both the vector and the memory buffer are released by libfuse
+    auto *vec = static_cast<struct fuse_bufvec *>(std::malloc(sizeof(struct fuse_bufvec)));
+    if (!vec)
+        return -ENOMEM;
+    *vec = FUSE_BUFVEC_INIT(size);
+
+    // Plaintext data is handed over as a file descriptor, letting the kernel splice it from the page cache
+    if (auto extent = handle.file->get_extent(offset, size); extent) {
+        vec->buf[0].size  = extent->size;
+        vec->buf[0].flags = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+        vec->buf[0].fd    = extent->file->get_fd();
+        vec->buf[0].pos   = extent->offset;
+    } else {
+        vec->buf[0].mem = std::malloc(size);
+        if (!vec->buf[0].mem) {
+            std::free(vec);
+            return -ENOMEM;
+        }
+
+        std::scoped_lock lk(handle.mtx);
+        vec->buf[0].size = handle.base->read_at(offset, vec->buf[0].mem, size);
+    }
+
+    *bufp = vec;
+    return 0;
+}
+
+int FuseContext::wrap_release(const char *path, struct fuse_file_info *info) {
+    FNX_UNUSED(path);
+    delete &get_handle(info);
+    return 0;
 }
 
 void *FuseContext::wrap_init(struct fuse_conn_info *conn) {
+#ifdef FUSE_CAP_SPLICE_WRITE
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+#else
     FNX_UNUSED(conn);
-    return s_fs;
+#endif
+
+    // Started here rather than before mounting, as threads would not survive daemonization
+    s_ctx->start_prefetch();
+    return s_ctx->filesys.get();
 }
 
 } // namespace fnx
@@ -17,13 +17,18 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <filesystem>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <fuse.h>
 
 #include "context.hpp"
+#include "thread_pool.hpp"
+#include "vfs.hpp"
 
 #ifdef FUSE_WINFSP_FUSE_H_INCLUDED
 #   undef stat
@@ -38,24 +43,52 @@ class FuseContext final: public Context {
             std::vector<std::string> fuse_args;
             bool                     raw_containers = false;
             bool                     background     = false;
+            std::size_t              max_loaded     = -1;
+            std::size_t              max_memory     = -1;
+            std::size_t              max_files      = -1;
+            std::size_t              prefetch_depth = 0;
+            std::size_t              prefetch_jobs  = 1;
         };
 
     public:
         FuseContext(const std::filesystem::path &container, std::filesystem::path &mountpoint);
+        FuseContext(const std::vector<std::filesystem::path> &containers, std::filesystem::path &mountpoint);
+        ~FuseContext();
+
         int run(const Options &options);
 
     private:
+        // Expands the tree in the background, so that it is already parsed when first accessed
+        void start_prefetch();
+
+        // Nodes of evicted subtrees are recreated when accessed again, so inode numbers are assigned
+        // per path for the lifetime of the mount, to stay the same across the kernel caches
+        ino_t get_ino(const std::string &path);
+
+        void  fill_folder_stat(struct stat *, const std::string &);
+        void  fill_file_stat(struct stat *, const std::string &, const File &);
+
         static int   wrap_getattr(const char *, struct stat *);
         static int   wrap_opendir(const char *, struct fuse_file_info *);
         static int   wrap_readdir(const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *);
         static int   wrap_releasedir(const char *, struct fuse_file_info *);
         static int   wrap_open(const char *, struct fuse_file_info *);
         static int   wrap_read(const char *, char *, size_t, off_t, struct fuse_file_info *);
+        static int   wrap_read_buf(const char *, struct fuse_bufvec **, size_t, off_t, struct fuse_file_info *);
+        static int   wrap_release(const char *, struct fuse_file_info *);
         static void *wrap_init(struct fuse_conn_info *);
 
     private:
         struct fuse_operations ops = {};
         std::filesystem::path mountpoint;
+
+        std::size_t prefetch_depth = 0, prefetch_jobs = 1;
+        std::atomic_bool stop_prefetch = false;
+        std::unique_ptr<TaskGroup> prefetcher;
+
+        std::mutex ino_mtx;
+        std::unordered_map<std::string, ino_t> inodes;
+        ino_t next_ino = 2; // 1 is the root
 };
 
 } // namespace fnx
@@ -0,0 +1,318 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <re2/re2.h>
+
+#include "matcher.hpp"
+#include "thread_pool.hpp"
+#include "vfs.hpp"
+#include "utils.hpp"
+
+#include "grep.hpp"
+
+namespace fnx {
+
+namespace {
+
+constexpr std::size_t   chunk_size = 0x400000;  // 4MiB
+constexpr std::uint64_t range_size = 0x4000000; // 64MiB
+
+// Regular expressions can match an arbitrary length, those spanning chunk boundaries are only found up to this one
+constexpr std::size_t max_regex_match = 0x1000;
+
+// Finds occurrences of the patterns in binary data
+// A single literal is searched for directly, anything else with one expression alternating all patterns
+class Searcher {
+    public:
+        Searcher(const std::vector<std::string> &patterns, const GrepContext::Options &options) {
+            std::string alternation;
+            for (auto &pattern: patterns) {
+                if (pattern.empty()) {
+                    this->error = "Empty pattern";
+                    return;
+                }
+
+                std::string literal, regex;
+                auto length = max_regex_match;
+                if (options.is_hex) {
+                    auto opt = Searcher::parse_signature(pattern, literal, regex);
+                    if (!opt) {
+                        this->error = "Invalid byte signature \"" + pattern + "\"";
+                        return;
+                    }
+                    length = *opt;
+                } else if (options.is_regex) {
+                    regex = pattern;
+                } else {
+                    literal = pattern;
+                    regex   = RE2::QuoteMeta(pattern);
+                    length  = pattern.size();
+                }
+
+                this->overlap = std::max(this->overlap, length - 1);
+                if ((patterns.size() == 1) && (literal.size() == length) && !options.case_insensitive) {
+                    this->literal = std::move(literal);
+                    return;
+                }
+
+                alternation.append(alternation.empty() ? "(?:" : "|(?:").append(regex).append(1, ')');
+            }
+
+            // Data is matched byte-wise
+            RE2::Options opts(RE2::Quiet);
+            opts.set_encoding(RE2::Options::EncodingLatin1);
+            opts.set_case_sensitive(!options.case_insensitive);
+            opts.set_dot_nl(true);
+            opts.set_never_capture(true);
+            this->regex = std::make_unique<RE2>(alternation, opts);
+            if (!this->regex->ok())
+                this->error = "Failed to compile expression: " + this->regex->error();
+        }
+
+        const std::string &get_error() const {
+            return this->error;
+        }
+
+        // Number of bytes past the reported matches needed to find them in full
+        std::size_t get_overlap() const {
+            return this->overlap;
+        }
+
+        // Calls on_match with the position of each match starting before limit, until it returns true
+        template <typename F>
+        void search(const std::uint8_t *data, std::size_t size, std::size_t limit, F &&on_match) const {
+            auto *text = reinterpret_cast<const char *>(data);
+            if (!this->regex) {
+                for (std::size_t pos = 0; pos < limit;) {
+#ifdef __GLIBC__
+                    auto *ptr = static_cast<const char *>(memmem(text + pos, size - pos, this->literal.data(), this->literal.size()));
+                    if (!ptr)
+                        break;
+                    auto found = static_cast<std::size_t>(ptr - text);
+#else
+                    auto found = std::string_view(text, size).find(this->literal, pos);
+#endif
+                    if ((found >= limit) || on_match(found))
+                        break;
+                    pos = found + this->literal.size();
+                }
+                return;
+            }
+
+            re2::StringPiece input(text, size), match;
+            for (std::size_t pos = 0; pos < limit;) {
+                if (!this->regex->Match(input, pos, size, RE2::UNANCHORED, &match, 1))
+                    break;
+
+                // Empty matches are skipped
+                auto found = static_cast<std::size_t>(match.data() - text);
+                if ((found >= limit) || (!match.empty() && on_match(found)))
+                    break;
+                pos = found + std::max(match.size(), std::size_t(1));
+            }
+        }
+
+    private:
+        // Parses a signature such as "de ad ?? ef", where ?? matches any byte, and returns its length
+        // Only the literal bytes are appended to literal
+        static std::optional<std::size_t> parse_signature(std::string_view hex, std::string &literal, std::string &regex) {
+            auto nibble = [](char c) -> int {
+                if (('0' <= c) && (c <= '9'))
+                    return c - '0';
+                c |= 0x20;
+                return (('a' <= c) && (c <= 'f')) ? c - 'a' + 10 : -1;
+            };
+
+            std::size_t length = 0;
+            for (std::size_t i = 0; i < hex.size();) {
+                if (std::isspace(static_cast<unsigned char>(hex[i]))) {
+                    ++i;
+                    continue;
+                }
+
+                if (i + 1 >= hex.size())
+                    return std::nullopt;
+
+                if ((hex[i] == '?') && (hex[i + 1] == '?')) {
+                    regex += '.';
+                } else if (auto hi = nibble(hex[i]), lo = nibble(hex[i + 1]); (hi >= 0) && (lo >= 0)) {
+                    std::array<char, 5> buf;
+                    std::snprintf(buf.data(), buf.size(), "\\x%02x", (hi << 4) | lo);
+                    literal += static_cast<char>((hi << 4) | lo);
+                    regex   += buf.data();
+                } else {
+                    return std::nullopt;
+                }
+                i += 2, ++length;
+            }
+
+            return length ? std::make_optional(length) : std::nullopt;
+        }
+
+    private:
+        std::string          literal;
+        std::unique_ptr<RE2> regex;
+        std::size_t          overlap = 0;
+        std::string          error;
+};
+
+// Printed once the last range of the file was searched
+struct FileMatches {
+    FileMatches(const std::string &path, bool files_only, std::mutex &stdout_mtx):
+        path(path), files_only(files_only), stdout_mtx(stdout_mtx) { }
+
+    ~FileMatches() {
+        if (this->offsets.empty())
+            return;
+
+        std::sort(this->offsets.begin(), this->offsets.end());
+        std::scoped_lock lk(this->stdout_mtx);
+        if (this->files_only) {
+            std::puts(this->path.c_str());
+            return;
+        }
+        for (auto offset: this->offsets)
+            std::printf("%s:0x%" PRIx64 "\n", this->path.c_str(), offset);
+    }
+
+    void add(std::uint64_t offset) {
+        std::scoped_lock lk(this->mtx);
+        this->offsets.push_back(offset);
+        this->found = true;
+    }
+
+    std::string path;
+    bool files_only;
+    std::atomic_bool found = false;
+
+    std::mutex &stdout_mtx;
+    std::mutex mtx;
+    std::vector<std::uint64_t> offsets;
+};
+
+} // namespace
+
+int GrepContext::run(const Options &options) {
+    Searcher searcher(this->patterns, options);
+    if (!searcher.get_error().empty()) {
+        std::fprintf(stderr, "%s\n", searcher.get_error().c_str());
+        return 2;
+    }
+
+    if (searcher.get_overlap() >= chunk_size / 2) {
+        std::fprintf(stderr, "Pattern is too long\n");
+        return 2;
+    }
+
+    NameFilter filter(options.names, false, false);
+    if (!filter.get_error().empty()) {
+        std::fprintf(stderr, "%s\n", filter.get_error().c_str());
+        return 2;
+    }
+
+    // The scheduler is created by the first folder expansion
+    set_scheduler_workers(options.jobs);
+
+    if (auto opt = this->filesys->find_folder(options.start); !opt) {
+        std::fprintf(stderr, "Could not find path \"%s\" inside container \"%s\"\n",
+            PATHSTR(options.start).c_str(), PATHSTR(container).c_str());
+        return 2;
+    }
+
+    TaskGroup group;
+
+    std::mutex stdout_mtx;
+    std::atomic_bool matched = false, failed = false;
+
+    // Chunks are read with enough data past their end to find the matches starting in them, which the next chunk skips
+    auto search_range = [&](FileMatches &matches, const File &src, std::uint64_t begin, std::uint64_t end) {
+        auto base = src.open();
+        auto buf  = io::BufferPool::acquire(chunk_size);
+        auto size = src.get_size();
+        for (auto offset = begin; offset < end;) {
+            if (options.files_only && matches.found)
+                return;
+
+            auto len = std::min<std::uint64_t>(chunk_size, size - offset);
+            if (base->read_at(offset, buf.data(), len) != len) {
+                std::fprintf(stderr, "Failed to read \"%s\" at offset 0x%" PRIx64 "\n", matches.path.c_str(), offset);
+                failed = true;
+                return;
+            }
+
+            auto limit = std::min(end - offset, (offset + len < size) ? len - searcher.get_overlap() : len);
+
+            // The next chunk is read from the host while this one is searched
+            if (offset + limit < end)
+                this->filesys->advise_willneed(src.get_host_offset() + offset + limit, chunk_size);
+
+            searcher.search(buf.data(), len, limit, [&](std::size_t pos) {
+                matches.add(offset + pos);
+                matched = true;
+                return options.files_only;
+            });
+            offset += limit;
+        }
+    };
+
+    // Tasks reference the above, make sure they completed before returning
+    FNX_SCOPEGUARD([&group] { group.join(); });
+
+    auto callback_folder = [](const std::string &, const std::shared_ptr<Folder> &) -> bool {
+        return false;
+    };
+
+    // Large files are split in ranges searched concurrently
+    auto callback_file = [&](const std::string &path, const std::shared_ptr<File> &file) -> bool {
+        if (!options.names.empty() && !filter.matches(file->get_name()))
+            return false;
+
+        auto matches = std::make_shared<FileMatches>(path, options.files_only, stdout_mtx);
+        for (std::uint64_t offset = 0, size = file->get_size(); offset < size; offset += range_size) {
+            group.run([&search_range, matches, file, offset, end = std::min(offset + range_size, size)] {
+                search_range(*matches, *file, offset, end);
+            });
+        }
+        return false;
+    };
+
+    this->filesys->walk(options.start, options.depth, callback_folder, callback_file);
+    try {
+        group.wait();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+
+    // Like grep(1): 0 if something matched, 1 otherwise, and 2 on errors
+    return failed ? 2 : matched ? 0 : 1;
+}
+
+} // namespace fnx
@@ -15,26 +15,135 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
 #include "utils.hpp"
 
 #include "list.hpp"
 
 namespace fnx {
 
+namespace {
+
+// Accumulates the output to write it in large blocks
+class OutputBuffer {
+    public:
+        ~OutputBuffer() {
+            this->flush();
+        }
+
+        OutputBuffer &append(std::string_view str) {
+            this->buf.append(str);
+            if (this->buf.size() >= flush_size)
+                this->flush();
+            return *this;
+        }
+
+        OutputBuffer &append(std::uint64_t value) {
+            std::array<char, 20> str;
+            auto [end, ec] = std::to_chars(str.begin(), str.end(), value);
+            return this->append(std::string_view(str.data(), end - str.data()));
+        }
+
+        // Quoted string, with JSON escapes
+        OutputBuffer &append_json(std::string_view str) {
+            this->buf += '"';
+            for (auto c: str) {
+                if ((c == '"') || (c == '\\')) {
+                    this->buf.append(1, '\\').append(1, c);
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    std::array<char, 7> esc;
+                    std::snprintf(esc.data(), esc.size(), "\\u%04x", c);
+                    this->buf += esc.data();
+                } else {
+                    this->buf += c;
+                }
+            }
+            return this->append("\"");
+        }
+
+        // Field quoted only when needed, with quotes doubled
+        OutputBuffer &append_csv(std::string_view str) {
+            if (str.find_first_of(",\"\r\n") == std::string_view::npos)
+                return this->append(str);
+
+            this->buf += '"';
+            for (auto c: str)
+                this->buf.append((c == '"') ? 2 : 1, c);
+            return this->append("\"");
+        }
+
+        void flush() {
+            std::fwrite(this->buf.data(), 1, this->buf.size(), stdout);
+            this->buf.clear();
+        }
+
+    private:
+        constexpr static std::size_t flush_size = 0x10000;
+
+        std::string buf;
+};
+
+} // namespace
+
 int ListContext::run(const Options &options) {
-    auto callback = [&](const std::filesystem::path &path) -> bool {
-        std::filesystem::path::iterator it;
-        for (it = path.begin(); it != --path.end(); ++it)
-            std::printf("%s", ListContext::indent.data());
-        std::puts(PATHSTR(*it).c_str());
+    if (auto opt = this->filesys->find_folder("/"); !opt)
+        return 1;
+
+    OutputBuffer out;
+
+    if (options.format == "tree") {
+        auto callback = [&](const std::string &path, const auto &node) -> bool {
+            for (auto i = std::count(path.begin(), path.end(), '/'); i > 0; --i)
+                out.append(ListContext::indent);
+            out.append(node->get_name()).append("\n");
+            return false;
+        };
+
+        out.append("/\n");
+        this->filesys->walk("/", options.depth, callback, callback);
+        return 0;
+    }
+
+    // Records hold the path, the type of node, the size and offset in the host file of files,
+    // and the kind of container the node is stored in
+    bool is_json = options.format == "jsonl";
+    if (!is_json)
+        out.append("path,type,size,offset,container\n");
+
+    auto record = [&](const std::string &path, const char *type, const File *file, const Folder &parent) {
+        auto container = parent.has_container() ? parent.get_container_name() : std::string_view();
+        if (is_json) {
+            out.append("{\"path\":").append_json(path).append(",\"type\":\"").append(type).append("\"");
+            if (file)
+                out.append(",\"size\":").append(file->get_size()).append(",\"offset\":").append(file->get_host_offset());
+            out.append(",\"container\":").append_json(container).append("}\n");
+        } else {
+            out.append_csv(path).append(",").append(type).append(",");
+            if (file)
+                out.append(file->get_size()).append(",").append(file->get_host_offset());
+            else
+                out.append(",");
+            out.append(",").append(container).append("\n");
+        }
+    };
+
+    auto callback_folder = [&](const std::string &path, const std::shared_ptr<Folder> &, const Folder &parent) -> bool {
+        record(path, "folder", nullptr, parent);
         return false;
     };
 
-    if (auto opt = this->filesys->find_folder("/"); !opt)
-        return 1;
+    auto callback_file = [&](const std::string &path, const std::shared_ptr<File> &file, const Folder &parent) -> bool {
+        record(path, "file", file.get(), parent);
+        return false;
+    };
 
-    std::puts("/");
-    this->filesys->walk("/", options.depth, callback, callback);
+    this->filesys->walk("/", options.depth, callback_folder, callback_file);
     return 0;
 }
 
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <string>
 #include <string_view>
 
 #include "context.hpp"
@@ -28,7 +29,8 @@ class ListContext: public Context {
         constexpr static std::string_view indent = "  ";
 
         struct Options {
-            std::size_t depth = -1;
+            std::size_t depth  = -1;
+            std::string format = "tree";
         };
 
     public:
@@ -15,6 +15,9 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstdio>
+#include <exception>
+
 #include <CLI/CLI.hpp>
 
 #include "options.hpp"
@@ -27,5 +30,12 @@ int _CRT_glob = 0;
 int main(int argc, char **argv) {
     auto opts = fnx::ProgramOptions("Fuse-Nx v" FUSENX_VERSION "\nBuilt on: " __DATE__ " " __TIME__);
     CLI11_PARSE(opts.app, argc, argv);
-    return opts.run();
+
+    // Errors raised by parallel tasks are rethrown to the thread waiting on them
+    try {
+        return opts.run();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
 }
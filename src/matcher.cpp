@@ -0,0 +1,136 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <string>
+#include <string_view>
+
+#include <fnx.hpp>
+
+#include "matcher.hpp"
+
+namespace fnx {
+
+namespace {
+
+bool is_char_class(std::string_view name) {
+    constexpr std::array<std::string_view, 12> classes = {
+        "alnum", "alpha", "blank", "cntrl", "digit", "graph", "lower", "print", "punct", "space", "upper", "xdigit",
+    };
+    return std::find(classes.begin(), classes.end(), name) != classes.end();
+}
+
+// Translates the bracket expression opening at glob[start] to a character class
+// Returns the position of the closing bracket, or npos if the expression is not terminated
+std::size_t translate_set(std::string_view glob, std::size_t start, std::string &regex) {
+    std::string set = "[";
+    auto pos = start + 1;
+    if ((pos < glob.size()) && ((glob[pos] == '!') || (glob[pos] == '^')))
+        set += '^', ++pos;
+
+    // A closing bracket right after the opening one (and the negation mark) is part of the set
+    for (auto first = pos; pos < glob.size(); ++pos) {
+        auto c = glob[pos];
+        if ((c == ']') && (pos != first)) {
+            regex.append(set).append(1, ']');
+            return pos;
+        }
+
+        // Named classes are copied as is, RE2 supports the same ones
+        if ((c == '[') && (pos + 1 < glob.size()) && (glob[pos + 1] == ':')) {
+            auto end = glob.find(":]", pos + 2);
+            if ((end != std::string_view::npos) && is_char_class(glob.substr(pos + 2, end - pos - 2))) {
+                set.append(glob.substr(pos, end + 2 - pos));
+                pos = end + 1;
+                continue;
+            }
+        }
+
+        bool escaped = (c == '\\') && (pos + 1 < glob.size());
+        if (escaped)
+            c = glob[++pos];
+
+        // Punctuation is escaped except for range dashes, letters and digits are not as they would form escape sequences
+        if (((c == '-') && !escaped) || !std::ispunct(static_cast<unsigned char>(c)))
+            set += c;
+        else
+            set.append(1, '\\').append(1, c);
+    }
+
+    return std::string_view::npos;
+}
+
+} // namespace
+
+NameFilter::NameFilter(const std::vector<std::string> &patterns, bool is_regex, bool case_insensitive):
+        set(NameFilter::make_options(is_regex, case_insensitive), RE2::ANCHOR_BOTH) {
+    for (auto &pattern: patterns) {
+        std::string error;
+        if (this->set.Add(is_regex ? pattern : NameFilter::glob_to_regex(pattern), &error) < 0) {
+            this->error = "Failed to compile expression \"" + pattern + "\": " + error;
+            return;
+        }
+    }
+
+    if (!this->set.Compile())
+        this->error = "Failed to compile expressions: out of memory";
+}
+
+RE2::Options NameFilter::make_options(bool is_regex, bool case_insensitive) {
+    RE2::Options opts(RE2::Quiet);
+#ifdef __MINGW32__
+    // Wildcards are case-insensitive on Windows
+    opts.set_case_sensitive(is_regex && !case_insensitive);
+#else
+    opts.set_case_sensitive(!case_insensitive);
+    FNX_UNUSED(is_regex);
+#endif
+    opts.set_never_capture(true);
+    return opts;
+}
+
+std::string NameFilter::glob_to_regex(std::string_view glob) {
+    std::string regex;
+    for (std::size_t i = 0; i < glob.size(); ++i) {
+        switch (auto c = glob[i]; c) {
+            case '*':
+                regex += ".*";
+                break;
+            case '?':
+                regex += '.';
+                break;
+            case '[':
+                if (auto end = translate_set(glob, i, regex); end != std::string_view::npos)
+                    i = end;
+                else
+                    regex += "\\[";
+                break;
+            case '\\':
+                if (i + 1 < glob.size())
+                    c = glob[++i];
+                [[fallthrough]];
+            default:
+                regex += RE2::QuoteMeta(std::string_view(&c, 1));
+                break;
+        }
+    }
+    return regex;
+}
+
+} // namespace fnx
@@ -0,0 +1,54 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <re2/re2.h>
+#include <re2/set.h>
+
+namespace fnx {
+
+// Matches names against a set of wildcard patterns or regular expressions
+// Patterns are compiled to a single automaton, which matches all of them in one pass over each name
+class NameFilter {
+    public:
+        NameFilter(const std::vector<std::string> &patterns, bool is_regex, bool case_insensitive);
+
+        // Empty if every pattern compiled
+        const std::string &get_error() const {
+            return this->error;
+        }
+
+        bool matches(const std::string &name) const {
+            return this->set.Match(name, nullptr);
+        }
+
+        // Translates a shell wildcard pattern to the equivalent regular expression
+        static std::string glob_to_regex(std::string_view glob);
+
+    private:
+        static RE2::Options make_options(bool is_regex, bool case_insensitive);
+
+    private:
+        RE2::Set    set;
+        std::string error;
+};
+
+} // namespace fnx
@@ -19,11 +19,15 @@
 
 #include <filesystem>
 #include <thread>
+#include <utility>
+#include <vector>
 #include <CLI/CLI.hpp>
 
+#include "cat.hpp"
 #include "dump.hpp"
 #include "find.hpp"
 #include "fuse.hpp"
+#include "grep.hpp"
 #include "list.hpp"
 #include "keys.hpp"
 
@@ -64,10 +68,11 @@ struct GeneralOptions {
 };
 
 struct FuseOptions {
-    CLI::App             *fuse_cmd;
-    std::filesystem::path container;
-    std::filesystem::path mountpoint;
-    FuseContext::Options  opts;
+    CLI::App                          *fuse_cmd;
+    std::filesystem::path              container;
+    std::vector<std::filesystem::path> extra_containers;
+    std::filesystem::path              mountpoint;
+    FuseContext::Options               opts;
 
     FuseOptions(CLI::App &app) {
         this->fuse_cmd = app.add_subcommand("mount", "Mount container as filesystem");
@@ -76,37 +81,87 @@ struct FuseOptions {
         this->fuse_cmd->add_flag("-b,--background", this->opts.background, "Operate in the background");
 #endif
         this->fuse_cmd->add_option("-o", this->opts.fuse_args, "Additional arguments forwarded to FUSE");
-        this->fuse_cmd->add_option("container", this->container, "Path of the container to mount")
-            ->check(CLI::ExistingFile)
+        this->fuse_cmd->add_option("-a,--add", this->extra_containers, "Mount an additional container or folder of containers")
+            ->check(CLI::ExistingPath);
+        this->fuse_cmd->add_option("--max-loaded", this->opts.max_loaded,
+                "Keep at most N containers opened when mounting several of them, unloading the least recently used ones")
+            ->type_name("N")
+            ->check(CLI::PositiveNumber);
+        this->fuse_cmd->add_option("--max-files", this->opts.max_files,
+                "Keep at most N host files open when mounting several containers, unloading the least recently used ones "
+                "(defaults to the limit of the process, minus some descriptors for FUSE)")
+            ->type_name("N")
+            ->check(CLI::PositiveNumber);
+        this->fuse_cmd->add_option("--max-memory", this->opts.max_memory,
+                "Unload the least recently used containers when their parsed metadata exceeds SIZE (eg. 512M)")
+            ->type_name("SIZE")
+            ->transform(CLI::AsSizeValue(false));
+        this->fuse_cmd->add_option("--prefetch", this->opts.prefetch_depth,
+                "Expand nested containers up to N levels deep in the background after mounting")
+            ->type_name("N")
+            ->check(CLI::NonNegativeNumber);
+        this->fuse_cmd->add_option("--prefetch-jobs", this->opts.prefetch_jobs, "Max number of jobs to spawn for prefetching")
+            ->type_name("N")
+            ->check(CLI::PositiveNumber);
+        this->fuse_cmd->add_option("container", this->container,
+                "Path of the container to mount, or of a folder whose containers will each be mounted as a subfolder")
+            ->check(CLI::ExistingPath)
             ->required();
         this->fuse_cmd->add_option("mountpoint", this->mountpoint, "Path of the mountpoint");
     }
 
     int run() {
-        return FuseContext(this->container, this->mountpoint).run(this->opts);
+        if (this->extra_containers.empty() && !std::filesystem::is_directory(this->container))
+            return FuseContext(this->container, this->mountpoint).run(this->opts);
+
+        if (this->mountpoint.empty()) {
+            std::fprintf(stderr, "A mountpoint is required when mounting several containers\n");
+            return 1;
+        }
+
+        this->extra_containers.insert(this->extra_containers.begin(), this->container);
+        return FuseContext(this->extra_containers, this->mountpoint).run(this->opts);
     }
 };
 
 struct FindOptions {
-    CLI::App             *find_cmd;
-    std::filesystem::path container;
-    std::string           exp;
-    FindContext::Options  opts;
+    CLI::App                *find_cmd;
+    std::filesystem::path    container;
+    std::string              exp;
+    std::vector<std::string> patterns;
+    FindContext::Options     opts;
 
     FindOptions(CLI::App &app) {
         this->find_cmd = app.add_subcommand("find", "Find file or folder in archive and print its full path");
         this->find_cmd->add_flag("-e,--regex", this->opts.is_regex, "Treat pattern as regular expression");
-#ifndef __MINGW32__
         this->find_cmd->add_flag("-i,--ignore-case", this->opts.case_insensitive, "Ignore case distinctions");
-#endif
+        this->find_cmd->add_option("-p,--pattern", this->patterns, "Additional expression to match, can be repeated")
+            ->type_name("EXP");
+        this->find_cmd->add_option("-f,--pattern-file", this->opts.patterns_file, "Read expressions to match from a file, one per line")
+            ->check(CLI::ExistingFile);
         this->find_cmd->add_option("-m,--max-count", this->opts.max_count, "Stop after N matches")
             ->type_name("N")
             ->check(CLI::NonNegativeNumber);
         this->find_cmd->add_option("-d,--depth", this->opts.depth, "Stop after N levels into the filesystem hierarchy")
             ->type_name("N")
             ->check(CLI::NonNegativeNumber);
+        this->find_cmd->add_option("-j,--jobs", this->opts.jobs, "Max number of jobs to spawn")
+            ->check(CLI::NonNegativeNumber);
+        this->find_cmd->add_flag("-u,--unordered", this->opts.unordered,
+            "Print matches as they are found when searching with several jobs, instead of in the order of the hierarchy");
+        this->find_cmd->add_option("-t,--type", this->opts.type, "Only match files (f) or folders (d)")
+            ->check(CLI::IsMember({"f", "d"}));
+        this->find_cmd->add_option("-s,--size", this->opts.size,
+                "Only match files of N bytes, more with +N, or less with -N (given as --size=-N), with an optional K/M/G/T suffix")
+            ->type_name("[+-]N");
+        this->find_cmd->add_option("-c,--container", this->opts.container_kind, "Only match nodes stored directly in a container of this kind")
+            ->check(CLI::IsMember({"Host", "Pfs", "Hfs", "RomFs", "Nca", "Xci"}, CLI::ignore_case));
+        this->find_cmd->add_option("--content-type", this->opts.content_type,
+                "Only match Nca containers of this content type, and their raw files")
+            ->check(CLI::IsMember({"Program", "Meta", "Control", "Manual", "Data", "PublicData"}, CLI::ignore_case));
         this->find_cmd->add_flag("-0", this->opts.null_terminator, "Terminate paths will a null character");
-        this->find_cmd->add_option("expression", this->exp, "Expression to match")
+        this->find_cmd->add_option("expression", this->exp,
+                "Expression to match, * to select nodes with the predicates only, or empty to only use -p and -f")
             ->required();
         this->find_cmd->add_option("container", this->container, "Path of the container to mount")
             ->check(CLI::ExistingFile)
@@ -116,7 +171,15 @@ struct FindOptions {
     }
 
     int run() {
-        return FindContext(this->container, this->exp).run(this->opts);
+        if (this->exp.empty() && this->patterns.empty() && this->opts.patterns_file.empty()) {
+            std::fprintf(stderr, "No expression to match\n");
+            return 1;
+        }
+
+        if (!this->exp.empty())
+            this->patterns.insert(this->patterns.begin(), this->exp);
+
+        return FindContext(this->container, this->patterns).run(this->opts);
     }
 };
 
@@ -133,11 +196,24 @@ struct DumpOptions {
             ->check(CLI::NonNegativeNumber);
         this->dump_cmd->add_option("-j,--jobs", this->opts.jobs, "Max number of jobs to spawn")
             ->check(CLI::NonNegativeNumber);
+        this->dump_cmd->add_flag("-l,--linear", this->opts.linear,
+            "Extract files in the order they are stored, reading the container in a single pass (for disks with slow seeking)");
+        this->dump_cmd->add_flag("-r,--resume", this->opts.resume,
+            "Resume a previous dump to the same destination, skipping the files it completed");
+        this->dump_cmd->add_flag("-s,--sparse", this->opts.sparse,
+            "Skip writing zero-filled blocks, leaving holes in the output files");
+        this->dump_cmd->add_option("-c,--checksum", this->opts.checksums,
+                "Hash the files while they are dumped, and record the digests to the manifest in the destination")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"sha256", "crc32"}));
+        this->dump_cmd->add_option("-f,--format", this->opts.format,
+                "Output format, either files in a folder or a tar archive streamed to the standard output (in storage order like --linear)")
+            ->check(CLI::IsMember({"dir", "tar"}));
         this->dump_cmd->add_option("container", this->container, "Path of the container to mount")
             ->check(CLI::ExistingFile)
             ->required();
-        this->dump_cmd->add_option("destination", this->dest, "Folder where to dump the files")
-            ->check(CLI::ExistingDirectory)
+        this->dump_cmd->add_option("destination", this->dest, "Folder where to dump the files, or - for the standard output")
+            ->check(CLI::ExistingDirectory | CLI::IsMember({"-"}))
             ->required();
         this->dump_cmd->add_option("paths", this->opts.paths, "Paths of the files and folder to dump inside the container");
         this->dump_cmd->allow_windows_style_options(false);
@@ -158,6 +234,9 @@ struct ListOptions {
         this->list_cmd->add_option("-d,--depth", this->opts.depth, "Stop after N levels into the filesystem hierarchy")
             ->type_name("N")
             ->check(CLI::NonNegativeNumber);
+        this->list_cmd->add_option("-f,--format", this->opts.format,
+                "Output format: indented tree of names, or records with the type, size, offset and container of each node")
+            ->check(CLI::IsMember({"tree", "jsonl", "csv"}));
         this->list_cmd->add_option("container", this->container, "Path of the container to mount")
             ->check(CLI::ExistingFile)
             ->required();
@@ -168,13 +247,80 @@ struct ListOptions {
     }
 };
 
+struct CatOptions {
+    CLI::App             *cat_cmd;
+    std::filesystem::path container;
+    std::filesystem::path path;
+    CatContext::Options   opts;
+
+    CatOptions(CLI::App &app) {
+        this->cat_cmd = app.add_subcommand("cat", "Write the content of a file to the standard output");
+        this->cat_cmd->add_option("-o,--offset", this->opts.offset, "Start reading at offset N into the file")
+            ->type_name("N")
+            ->check(CLI::NonNegativeNumber);
+        this->cat_cmd->add_option("-l,--length", this->opts.length, "Stop after N bytes")
+            ->type_name("N")
+            ->check(CLI::NonNegativeNumber);
+        this->cat_cmd->add_option("container", this->container, "Path of the container to mount")
+            ->check(CLI::ExistingFile)
+            ->required();
+        this->cat_cmd->add_option("path", this->path, "Path of the file inside the container")
+            ->required();
+        this->cat_cmd->allow_windows_style_options(false);
+    }
+
+    int run() {
+        return CatContext(this->container, this->path).run(this->opts);
+    }
+};
+
+struct GrepOptions {
+    CLI::App                *grep_cmd;
+    std::filesystem::path    container;
+    std::string              pattern;
+    std::vector<std::string> patterns;
+    GrepContext::Options     opts;
+
+    GrepOptions(CLI::App &app) {
+        this->grep_cmd = app.add_subcommand("grep", "Search the contents of files in archive, and print the offsets of the matches "
+            "(exits with 0 if something matched, 1 otherwise, and 2 on errors)");
+        auto *regex = this->grep_cmd->add_flag("-e,--regex", this->opts.is_regex, "Treat pattern as regular expression");
+        this->grep_cmd->add_flag("-x,--hex", this->opts.is_hex, "Treat pattern as hexadecimal bytes, ?? matching any byte")
+            ->excludes(regex);
+        this->grep_cmd->add_flag("-i,--ignore-case", this->opts.case_insensitive, "Ignore case distinctions");
+        this->grep_cmd->add_option("-p,--pattern", this->patterns, "Additional pattern to search for, can be repeated")
+            ->type_name("PATTERN");
+        this->grep_cmd->add_option("-n,--name", this->opts.names, "Only search files whose name matches the wildcard, can be repeated")
+            ->type_name("NAME");
+        this->grep_cmd->add_flag("-l,--files-with-matches", this->opts.files_only, "Only print the paths of files with matches");
+        this->grep_cmd->add_option("-d,--depth", this->opts.depth, "Stop after N levels into the filesystem hierarchy")
+            ->type_name("N")
+            ->check(CLI::NonNegativeNumber);
+        this->grep_cmd->add_option("-j,--jobs", this->opts.jobs, "Max number of jobs to spawn")
+            ->check(CLI::NonNegativeNumber);
+        this->grep_cmd->add_option("pattern", this->pattern, "Pattern to search for")
+            ->required();
+        this->grep_cmd->add_option("container", this->container, "Path of the container to mount")
+            ->check(CLI::ExistingFile)
+            ->required();
+        this->grep_cmd->add_option("path", this->opts.start, "Path to search in inside the container");
+        this->grep_cmd->allow_windows_style_options(false);
+    }
+
+    int run() {
+        this->patterns.insert(this->patterns.begin(), this->pattern);
+        return GrepContext(this->container, this->patterns).run(this->opts);
+    }
+};
+
 class ProgramOptions {
     public:
         template <typename ...Args>
         ProgramOptions(Args &&...args):
                 app(std::forward<Args>(args)...),
                 keyopts(this->app),  genopts(this->app),
-                fuseopts(this->app), findopts(this->app), dumpopts(this->app), listopts(this->app) {
+                fuseopts(this->app), findopts(this->app), dumpopts(this->app), listopts(this->app),
+                catopts(this->app),  grepopts(this->app) {
             this->app.set_help_all_flag("--help-all", "Expand all help");
             this->app.require_subcommand(1);
         }
@@ -191,6 +337,10 @@ class ProgramOptions {
                 return this->dumpopts.run();
             else if (this->listopts.list_cmd->parsed())
                 return this->listopts.run();
+            else if (this->catopts.cat_cmd->parsed())
+                return this->catopts.run();
+            else if (this->grepopts.grep_cmd->parsed())
+                return this->grepopts.run();
             return 0;
         }
 
@@ -202,6 +352,8 @@ class ProgramOptions {
         FindOptions    findopts;
         DumpOptions    dumpopts;
         ListOptions    listopts;
+        CatOptions     catopts;
+        GrepOptions    grepopts;
 };
 
 } // namespace fnx
@@ -19,87 +19,321 @@
 
 #include <algorithm>
 #include <atomic>
-#include <condition_variable>
-#include <functional>
+#include <concepts>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <fnx/utils.hpp>
+
 namespace fnx {
 
-template <typename Params>
-class ThreadPool {
+// Move-only type-erased callable
+class Task {
     public:
-        template <typename F>
-        ThreadPool(F &&worker_func): worker_func(worker_func) { }
+        Task() = default;
+
+        template <typename F> requires (!std::same_as<std::remove_cvref_t<F>, Task>)
+        Task(F &&func): impl(std::make_unique<Impl<std::decay_t<F>>>(std::forward<F>(func))) { }
+
+        void operator()() {
+            this->impl->call();
+        }
 
-        ~ThreadPool() {
-            if (!this->exited)
-                this->stop_workers();
+        explicit operator bool() const {
+            return static_cast<bool>(this->impl);
         }
 
-        void start_workers(std::size_t num_workers) {
+    private:
+        struct ImplBase {
+            virtual ~ImplBase() = default;
+            virtual void call() = 0;
+        };
+
+        template <typename F>
+        struct Impl final: ImplBase {
+            template <typename G>
+            Impl(G &&func): func(std::forward<G>(func)) { }
+
+            virtual void call() override {
+                this->func();
+            }
+
+            F func;
+        };
+
+        std::unique_ptr<ImplBase> impl;
+};
+
+// Work-stealing scheduler
+// Each worker owns a deque, pushing and popping its own tasks at the back (depth-first, cache-friendly),
+// while idle workers steal from the front of the others' (oldest and usually largest tasks)
+// Threads waiting for work to complete execute pending tasks in the meantime, so tasks can submit
+// and wait on nested work without starving the pool
+class Scheduler {
+    public:
+        Scheduler(std::size_t num_workers) {
             num_workers = std::max(static_cast<std::size_t>(1), num_workers);
 
+            this->queues.reserve(num_workers);
+            for (std::size_t i = 0; i < num_workers; ++i)
+                this->queues.emplace_back(std::make_unique<WorkQueue>());
+
             this->workers.reserve(num_workers);
             for (std::size_t i = 0; i < num_workers; ++i)
-                this->workers.emplace_back(std::thread(&ThreadPool::worker_thread_func, this));
+                this->workers.emplace_back(&Scheduler::worker_thread_func, this, i);
         }
 
-        void stop_workers() {
+        ~Scheduler() {
             this->is_exiting = true;
-            this->condvar.notify_all();
+            ++this->work_epoch;
+            this->work_epoch.notify_all();
             for (auto &t: this->workers)
                 t.join();
-            this->exited = true;
-        }
-
-        void wait() {
-            while (!this->pending_args.empty())
-                std::this_thread::yield();
         }
 
         std::size_t get_num_workers() const {
             return this->workers.size();
         }
 
-        void queue_item(const Params &args) {
-            std::scoped_lock lk(this->pending_args_mtx);
-            this->pending_args.push(args);
-            this->condvar.notify_one();
+        void submit(Task &&task) {
+            // Tasks submitted from a worker go to its own queue, others are spread across workers
+            auto idx = (Scheduler::cur_sched == this) ? Scheduler::cur_idx : this->next_queue++ % this->queues.size();
+
+            {
+                auto &queue = *this->queues[idx];
+                std::scoped_lock lk(queue.mtx);
+                queue.tasks.push_back(std::move(task));
+            }
+
+            // Only idle workers sleep on this, so waking a single one is enough to pick up the task
+            ++this->work_epoch;
+            this->work_epoch.notify_one();
+        }
+
+        // Runs tasks obtained from take until pred returns true, sleeping until a completion while none are available
+        template <typename Pred, typename Take>
+        void run_until(Pred &&pred, Take &&take) {
+            this->run_until(pred, take, this->done_epoch);
+        }
+
+        // Wakes up threads waiting on work to complete, to reevaluate their condition
+        void signal_done() {
+            ++this->done_epoch;
+            this->done_epoch.notify_all();
         }
 
     private:
-        void worker_thread_func() {
-            while (!this->is_exiting) {
-                std::unique_lock lk(this->pending_args_mtx);
-                this->condvar.wait(lk,
-                    [this] { return this->is_exiting || !this->pending_args.empty(); });
+        struct WorkQueue {
+            std::mutex       mtx;
+            std::deque<Task> tasks;
+        };
 
-                if (this->is_exiting)
-                    return;
+        Task try_take() {
+            auto num_queues = this->queues.size();
 
-                Params args = std::move(this->pending_args.front());
-                this->pending_args.pop();
-                lk.unlock();
+            std::size_t start = 0;
+            if (Scheduler::cur_sched == this) {
+                auto &queue = *this->queues[Scheduler::cur_idx];
+                std::scoped_lock lk(queue.mtx);
+                if (!queue.tasks.empty()) {
+                    auto task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                    return task;
+                }
+                start = Scheduler::cur_idx + 1;
+            }
+
+            for (std::size_t i = 0; i < num_queues; ++i) {
+                auto &queue = *this->queues[(start + i) % num_queues];
+                std::scoped_lock lk(queue.mtx);
+                if (!queue.tasks.empty()) {
+                    auto task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                    return task;
+                }
+            }
+
+            return {};
+        }
+
+        template <typename Pred, typename Take>
+        void run_until(Pred &&pred, Take &&take, std::atomic_uint32_t &epoch) {
+            while (!pred()) {
+                auto cur_epoch = epoch.load();
+                if (auto task = take(); task) {
+                    task();
+                    continue;
+                }
 
-                this->worker_func(std::move(args));
+                if (pred())
+                    break;
+                epoch.wait(cur_epoch);
             }
         }
 
+        void worker_thread_func(std::size_t idx) {
+            Scheduler::cur_sched = this;
+            Scheduler::cur_idx   = idx;
+            this->run_until([this] { return this->is_exiting.load(); }, [this] { return this->try_take(); }, this->work_epoch);
+        }
+
     private:
-        bool exited = false;
+        static inline thread_local Scheduler  *cur_sched = nullptr;
+        static inline thread_local std::size_t cur_idx   = 0;
 
-        std::function<void(Params)> worker_func;
-        std::vector<std::thread>    workers;
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic_size_t next_queue = 0;
 
-        std::atomic_bool        is_exiting = false;
-        std::condition_variable condvar;
+        // Idle workers and waiters sleep on separate counters, so that a new task never wakes a waiter
+        // which could not run it instead of a worker
+        std::atomic_uint32_t work_epoch = 0, done_epoch = 0;
+        std::atomic_bool is_exiting = false;
+};
+
+namespace detail {
+
+inline std::atomic_size_t shared_workers = 0;
+
+} // namespace detail
+
+// Sets the number of workers of the shared scheduler, only effective before its first use
+// 0 (the default) uses the hardware concurrency
+inline void set_scheduler_workers(std::size_t num_workers) {
+    detail::shared_workers = num_workers;
+}
+
+// Process-wide scheduler, which all parallel work should share to avoid oversubscription
+inline Scheduler &get_scheduler() {
+    static Scheduler sched(detail::shared_workers ? detail::shared_workers.load() : std::thread::hardware_concurrency());
+    return sched;
+}
+
+// Set of tasks whose completion can be waited on
+// Waiting executes the pending tasks of the group, so groups can be nested from within tasks
+// Only tasks of the group are run, as running unrelated ones could reenter locks held by the waiting thread
+// The first exception thrown by a task is rethrown by wait, once all tasks completed
+class TaskGroup {
+    public:
+        TaskGroup(Scheduler &sched = get_scheduler()): sched(sched), state(std::make_shared<State>()) { }
+
+        ~TaskGroup() {
+            this->join();
+        }
+
+        template <typename F>
+        void run(F &&func) {
+            // Counted before being queued, as it might complete before this returns
+            ++this->state->pending;
+            {
+                std::scoped_lock lk(this->state->mtx);
+                this->state->tasks.emplace_back(std::forward<F>(func));
+            }
+
+            // The scheduler only receives a handle, which becomes a no-op if the waiter already ran the task
+            this->sched.submit([&sched = this->sched, state = this->state] {
+                if (auto task = state->take_oldest(); task)
+                    state->run(sched, task);
+            });
+        }
+
+        void wait() {
+            this->join();
 
-        std::mutex         pending_args_mtx;
-        std::queue<Params> pending_args;
+            std::exception_ptr error;
+            {
+                std::scoped_lock lk(this->state->mtx);
+                error = std::exchange(this->state->error, nullptr);
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // Waits without rethrowing, for cleanup paths: exceptions not collected by wait are dropped
+        void join() {
+            auto &state = *this->state;
+            this->sched.run_until([&state] { return state.pending == 0; }, [this, &state] {
+                auto task = state.take_newest();
+                return task ? Task([this, &state, task = std::move(task)]() mutable { state.run(this->sched, task); }) : Task();
+            });
+        }
+
+    private:
+        struct State {
+            std::mutex         mtx;
+            std::deque<Task>   tasks;
+            std::atomic_size_t pending = 0;
+            std::exception_ptr error; // First exception thrown by a task, guarded by mtx
+
+            Task take_oldest() {
+                std::scoped_lock lk(this->mtx);
+                if (this->tasks.empty())
+                    return {};
+                auto task = std::move(this->tasks.front());
+                this->tasks.pop_front();
+                return task;
+            }
+
+            Task take_newest() {
+                std::scoped_lock lk(this->mtx);
+                if (this->tasks.empty())
+                    return {};
+                auto task = std::move(this->tasks.back());
+                this->tasks.pop_back();
+                return task;
+            }
+
+            void run(Scheduler &sched, Task &task) {
+                // Whatever the task captured is released before it counts as completed, even if it threw
+                FNX_SCOPEGUARD([&] {
+                    task = Task();
+                    if (--this->pending == 0)
+                        sched.signal_done();
+                });
+
+                try {
+                    task();
+                } catch (...) {
+                    std::scoped_lock lk(this->mtx);
+                    if (!this->error)
+                        this->error = std::current_exception();
+                }
+            }
+        };
+
+        Scheduler &sched;
+        std::shared_ptr<State> state;
 };
 
+// Calls func for every index in [0, count) on up to max_workers threads, and returns once all calls completed
+// The calling thread takes part in the work
+template <typename F>
+void parallel_for(std::size_t count, F &&func, std::size_t max_workers = -1) {
+    if ((count <= 1) || (max_workers <= 1)) {
+        for (std::size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic_size_t next = 0;
+    auto work = [&next, count, &func] {
+        for (std::size_t i; (i = next++) < count;)
+            func(i);
+    };
+
+    TaskGroup group;
+    auto num_helpers = std::min({ count, max_workers, get_scheduler().get_num_workers() + 1 }) - 1;
+    for (std::size_t i = 0; i < num_helpers; ++i)
+        group.run(work);
+    work();
+    group.wait();
+}
+
 } // namespace fnx
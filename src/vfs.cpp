@@ -15,115 +15,286 @@
 // You should have received a copy of the GNU General Public License
 // along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <fcntl.h>
+
+#include "thread_pool.hpp"
+
 #include "vfs.hpp"
 
 namespace fnx {
 
 namespace fs = std::filesystem;
 
-namespace {
+std::optional<std::shared_ptr<Folder>> File::make_container() const {
+    auto container = ContainerBase::open(this->base->clone());
+    if (!container)
+        return std::nullopt;
+
+    auto &name = this->get_name();
+    return std::make_shared<Folder>(name.substr(0, name.find_last_of('.')), std::move(container));
+}
+
+FileSystem::FileSystem(const std::vector<fs::path> &paths): library(true) {
+    std::vector<fs::path> containers;
+    for (auto &path: paths) {
+        if (!fs::is_directory(path)) {
+            containers.push_back(path);
+            continue;
+        }
+
+        std::error_code ec;
+        for (auto &entry: fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec))
+            if (entry.is_regular_file() && should_try_container(entry.path().filename().string()))
+                containers.push_back(entry.path());
+    }
+    std::sort(containers.begin(), containers.end());
+
+    auto root = std::make_shared<Folder>();
+    for (auto &path: containers) {
+        // Entries are named after the containers, disambiguated with a suffix on collision
+        auto name = path.stem().string();
+        for (int i = 2; std::any_of(root->get_children().begin(), root->get_children().end(),
+                [&name](auto &c) { return c->get_name() == name; }); ++i)
+            name = path.stem().string() + " (" + std::to_string(i) + ")";
+
+        auto folder = std::make_shared<Folder>(std::move(name), std::make_unique<HostContainer>(path));
+        this->add_folder("/" + folder->get_name(), folder);
+        root->add_child(std::move(folder));
+    }
+    this->add_folder("/", std::move(root));
+}
+
+void FileSystem::advise_sequential() const {
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (this->library)
+        return;
+
+    if (auto extent = this->base.get_extent(0, this->base.get_size()); extent)
+        posix_fadvise(extent->file->get_fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void FileSystem::advise_willneed(std::uint64_t offset, std::uint64_t size) const {
+#ifdef POSIX_FADV_WILLNEED
+    if (this->library)
+        return;
 
-void try_load_ticket_key(ContainerBase *container) {
-    for (auto &&[name, file, _]: container->read_files()) {
-        constexpr std::size_t tik_size = 0x2c0;
-        if (name.ends_with(".tik") && file->size() >= tik_size) {
-            auto dat = file->read(tik_size);
+    if (auto extent = this->base.get_extent(offset, size); extent)
+        posix_fadvise(extent->file->get_fd(), extent->offset, extent->size, POSIX_FADV_WILLNEED);
+#else
+    FNX_UNUSED(offset, size);
+#endif
+}
 
-            std::printf("Detected ticket %s, loading title key\n", name.c_str());
+std::optional<std::shared_ptr<Folder>> FileSystem::process_dir(const fs::path &path) {
+    auto normalized = FileSystem::normalize_path(PATHSTR(path));
+    auto opt = this->get_folder(normalized);
+    if (opt)
+        this->expand(normalized, *opt);
+    return opt;
+}
 
-            RightsId rights_id;
-            std::copy_n(dat.data() + 0x2a0, sizeof(rights_id), rights_id.begin());
+void FileSystem::expand(const std::string &path, const std::shared_ptr<Folder> &dir) {
+    if (this->is_tracking())
+        this->touch(path);
 
-            crypt::AesKey key;
-            std::copy_n(dat.data() + 0x180, sizeof(key), key.begin());
+    if (dir->is_processed())
+        return;
 
-            crypt::TitlekeySet::get()->set_key(rights_id, key);
+    // Register the contents before the folder is marked as processed, so that concurrent
+    // lookups observing it as such can always find them
+    auto publish = [this, &path](const Folder &dir) {
+        auto prefix = (path == "/") ? path : path + '/';
+        auto child_path = [&prefix](const Node &node) {
+            return prefix + node.get_name();
+        };
+
+        {
+            std::unique_lock lk(this->folders_lock);
+            for (const auto &folder: dir.get_children())
+                this->folders.try_emplace(child_path(*folder), folder);
+        }
+        {
+            std::unique_lock lk(this->files_lock);
+            for (const auto &file: dir.get_files())
+                this->files.try_emplace(child_path(*file), file);
+        }
+    };
+
+    if (!dir->process(this->keep_raw, publish))
+        return;
+
+    // Expanded containers are tracked for eviction, except for the root which is always needed
+    if (this->is_tracking() && (path != "/")) {
+        bool is_top = path.find('/', 1) == std::string::npos;
+
+        std::scoped_lock lk(this->loaded_mtx);
+        auto [it, inserted] = this->loaded.try_emplace(path, LoadedContainer{ dir, dir->get_footprint(), is_top, {}, {} });
+        if (inserted) {
+            auto &entry = it->second;
+            entry.lru_it = this->lru.insert(this->lru.end(), path);
+            if (is_top)
+                entry.top_it = this->lru_top.insert(this->lru_top.end(), path);
+
+            this->loaded_top    += is_top;
+            this->loaded_memory += entry.footprint;
+            this->promote(path);
         }
     }
 }
 
-} // namespace
+void FileSystem::touch(const std::string &path) {
+    std::scoped_lock lk(this->loaded_mtx);
+    this->promote(path);
+}
 
+void FileSystem::promote(const std::string &path) {
+    // Accessing a folder counts as an access of all its ancestors, which are moved after it
+    // so that they are never colder than their descendants
+    for (auto pos = path.size(); (pos != std::string::npos) && (pos > 0); pos = path.rfind('/', pos - 1)) {
+        if (auto it = this->loaded.find(path.substr(0, pos)); it != this->loaded.end()) {
+            auto &entry = it->second;
+            this->lru.splice(this->lru.end(), this->lru, entry.lru_it);
+            if (entry.is_top)
+                this->lru_top.splice(this->lru_top.end(), this->lru_top, entry.top_it);
+        }
+    }
+}
 
-std::optional<std::shared_ptr<Folder>> File::make_container() const {
-    std::unique_ptr<ContainerBase> container;
+void FileSystem::trim() {
+    // Host files are held by the top-level containers of a library, but also by the nodes and storage chains
+    // still referenced after their container was unloaded (eg. open FUSE handles), so the actual count is used
+    auto over_files = [this] {
+        return io::File::get_num_open() > this->max_files;
+    };
+
+    auto over_budget = [this, &over_files] {
+        return (this->loaded_top > this->max_loaded) || over_files() || (this->loaded_memory > this->max_memory);
+    };
+
+    {
+        std::scoped_lock lk(this->loaded_mtx);
+        if (!over_budget())
+            return;
+    }
 
-    auto fmt = hac::match(this->base->read_at(0, 0x400));
-    switch (fmt) {
-        case hac::Format::Pfs:
-            container = std::make_unique<PfsContainer>(this->base->clone());
-            break;
-        case hac::Format::Hfs:
-            container = std::make_unique<HfsContainer>(this->base->clone());
+    std::unique_lock tree_lk(this->tree_lock);
+    std::scoped_lock lk(this->loaded_mtx);
+    while (over_budget()) {
+        // When over the container or file count, only top-level containers are candidates for eviction
+        auto &order = ((this->loaded_top > this->max_loaded) || over_files()) ? this->lru_top : this->lru;
+        if (order.empty())
             break;
-        case hac::Format::RomFs:
-            container = std::make_unique<RomFsContainer>(this->base->clone());
-            break;
-        case hac::Format::Nca:
-            container = std::make_unique<NcaContainer>(this->base->clone());
-            break;
-        case hac::Format::Xci:
-            container = std::make_unique<XciContainer>(this->base->clone());
-            break;
-        case hac::Format::Unknown:
-        default:
-            return std::nullopt;
+
+        auto path = order.front();
+        this->collapse(path, this->loaded.at(path).folder);
     }
+}
 
-    if (!container->parse())
-        return std::nullopt;
+void FileSystem::untrack(const std::string &path) {
+    auto it = this->loaded.find(path);
+    if (it == this->loaded.end())
+        return;
 
-    if (fmt == hac::Format::Pfs)
-        try_load_ticket_key(container.get());
+    auto &entry = it->second;
+    this->lru.erase(entry.lru_it);
+    if (entry.is_top)
+        this->lru_top.erase(entry.top_it);
 
-    auto &name = this->get_name();
-    return std::make_shared<Folder>(name.substr(0, name.find_last_of('.')), std::move(container));
+    this->loaded_top    -= entry.is_top;
+    this->loaded_memory -= entry.footprint;
+    this->loaded.erase(it);
 }
 
-std::optional<std::shared_ptr<Folder>> FileSystem::process_dir(const fs::path &path) {
-    auto opt = this->get_folder(FileSystem::normalize_path(PATHSTR(path)));
-    if (!opt)
-        return opt;
-
-    auto dir = *opt;
-    if (dir->is_processed())
-        return opt;
-    dir->process(this->keep_raw);
-
-    for (const auto &folder: dir->get_children())
-        this->add_folder(path / folder->get_name(), folder);
+void FileSystem::collapse(const std::string &path, const std::shared_ptr<Folder> &folder) {
+    // Only the subtree is visited, as it holds exactly the nodes registered by its expansion
+    // Processed descendants were tracked, and are released along with the folder
+    auto unregister = [this](auto &self, const std::string &prefix, const Folder &dir) -> void {
+        for (auto &file: dir.get_files())
+            this->files.erase(prefix + file->get_name());
+
+        for (auto &child: dir.get_children()) {
+            auto child_path = prefix + child->get_name();
+            this->folders.erase(child_path);
+            if (child->is_processed()) {
+                this->untrack(child_path);
+                self(self, child_path + '/', *child);
+            }
+        }
+    };
 
-    for (const auto &file: dir->get_files())
-        this->add_file(path / file->get_name(), file);
+    auto keep = folder;
+    {
+        std::scoped_lock lk(this->files_lock, this->folders_lock);
+        unregister(unregister, path + '/', *keep);
+    }
 
-    return opt;
+    this->untrack(path);
+    keep->collapse();
 }
 
-void Folder::process(bool keep_raw) {
+bool Folder::process(bool keep_raw, const std::function<void(const Folder &)> &publish) {
     std::scoped_lock lk(this->processed_mtx);
 
-    if (!this->base && this->processed)
-        return;
+    if (!this->base || this->processed)
+        return false;
+
+    auto entries = this->base->read_files();
 
-    for (auto &&[name, file, try_container]: this->base->read_files()) {
-        auto f = std::make_shared<File>(std::move(name), std::move(file));
+    std::vector<std::shared_ptr<File>> files;
+    files.reserve(entries.size());
+    for (auto &&[name, file, _]: entries)
+        files.emplace_back(std::make_shared<File>(std::move(name), std::move(file)));
+
+    // Probing and parsing nested containers is independent for each entry, so it is done in parallel
+    std::vector<std::optional<std::shared_ptr<Folder>>> containers(entries.size());
+    parallel_for(entries.size(), [&](std::size_t i) {
+        if (std::get<2>(entries[i]))
+            containers[i] = files[i]->make_container();
+    });
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        bool try_container = std::get<2>(entries[i]);
 
         bool keep_file = keep_raw;
         if (try_container) {
-            if (auto cont = f->make_container(); cont)
-                this->children.emplace_back(std::move(*cont));
+            if (containers[i])
+                this->children.emplace_back(std::move(*containers[i]));
             else
                 keep_file = true;
         }
 
         if (!try_container || keep_file)
-            this->files.emplace_back(std::move(f));
+            this->files.emplace_back(std::move(files[i]));
     }
 
+    auto node_footprint = [](const Node &node) {
+        return Folder::node_footprint + node.get_name().capacity();
+    };
+
     for (auto &&[name, container]: this->base->read_folders())
         this->children.emplace_back(std::make_shared<Folder>(std::move(name), std::move(container)));
 
+    this->footprint = this->base->footprint();
+    for (auto &file: this->files)
+        this->footprint += node_footprint(*file);
+    for (auto &child: this->children)
+        this->footprint += node_footprint(*child);
+
+    publish(*this);
     this->processed = true;
+    return true;
+}
+
+void Folder::collapse() {
+    std::scoped_lock lk(this->processed_mtx);
+
+    this->files.clear();
+    this->children.clear();
+    if (this->base)
+        this->base->release();
+    this->footprint = 0;
+    this->processed = false;
 }
 
 std::optional<std::shared_ptr<Folder>> FileSystem::find_folder(const fs::path &path) {
@@ -144,31 +315,4 @@ std::optional<std::shared_ptr<Folder>> FileSystem::find_folder(const fs::path &p
     return cur_dir;
 }
 
-bool FileSystem::walk(const fs::path &location, std::size_t depth, const std::function<bool(const std::filesystem::path &)> &callback_folder,
-        const std::function<bool(const std::filesystem::path &)> &callback_file) {
-    if (!depth)
-        return false;
-
-    auto opt = this->get_folder(FileSystem::normalize_path(PATHSTR(location)));
-    if (!opt)
-        return true;
-
-    for (auto &d: (*opt)->get_children()) {
-        auto path = location / d->get_name();
-        this->process_dir(path);
-
-        if (callback_folder(path))
-            return true;
-        if (this->walk(path, depth - 1, callback_folder, callback_file))
-            return true;
-    }
-
-    for (auto &f: (*opt)->get_files()) {
-        if (callback_file(location / f->get_name()))
-            return true;
-    }
-
-    return false;
-}
-
 } // namespace fnx
@@ -17,13 +17,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -71,6 +76,20 @@ class File final: public Node {
             return this->base->read_at(offset, buf, size);
         }
 
+        // Offset of the data within the host file
+        std::size_t get_host_offset() const {
+            return this->base->parent_offset();
+        }
+
+        std::optional<io::Extent> get_extent(std::size_t offset, std::size_t size) const {
+            return this->base->get_extent(offset, size);
+        }
+
+        // Creates an independent storage chain for reading the file
+        std::unique_ptr<io::FileBase> open() const {
+            return this->base->clone();
+        }
+
     private:
         std::unique_ptr<io::FileBase> base;
 };
@@ -82,12 +101,22 @@ class Folder final: public Node {
         Folder(std::string &&name, std::unique_ptr<ContainerBase> &&base):
             Node(std::move(name)), base(std::move(base)) { }
 
-        void process(bool keep_raw);
+        // Returns whether the contents were populated by this call
+        // publish is invoked with the populated folder before it is marked as processed
+        bool process(bool keep_raw, const std::function<void(const Folder &)> &publish);
+
+        // Reverts the folder to its unprocessed state, releasing its contents
+        void collapse();
 
         bool is_processed() const {
             return this->processed;
         }
 
+        // Rough estimate of the memory held by the contents of the folder
+        std::size_t get_footprint() const {
+            return this->footprint;
+        }
+
         const std::vector<std::shared_ptr<File>> &get_files() const {
             return this->files;
         }
@@ -112,9 +141,17 @@ class Folder final: public Node {
             return this->base->name();
         }
 
+        std::string_view get_content_type() const {
+            return this->base->content_type();
+        }
+
     private:
-        bool processed = false;
+        // Approximate size of a node along with its storage chain
+        constexpr static std::size_t node_footprint = 0x200;
+
+        std::atomic_bool processed = false;
         std::mutex processed_mtx;
+        std::size_t footprint = 0;
         std::unique_ptr<ContainerBase> base;
         std::vector<std::shared_ptr<File>>   files;
         std::vector<std::shared_ptr<Folder>> children;
@@ -128,10 +165,47 @@ class FileSystem {
                 this->add_folder("/", std::move(*root));
         }
 
+        // Library of containers, each exposed as a top-level folder and opened lazily
+        // Directories are searched recursively for files with a container extension
+        FileSystem(const std::vector<std::filesystem::path> &paths);
+
         void set_keep_raw(bool keep) {
             this->keep_raw = keep;
         }
 
+        void set_max_loaded(std::size_t max) {
+            this->max_loaded = max;
+        }
+
+        void set_max_memory(std::size_t max) {
+            this->max_memory = max;
+        }
+
+        void set_max_files(std::size_t max) {
+            this->max_files = max;
+        }
+
+        // Hints the host that the image is about to be read sequentially
+        void advise_sequential() const;
+
+        // Hints the host that a range of the image is about to be read, so it gets read ahead in the background
+        void advise_willneed(std::uint64_t offset, std::uint64_t size) const;
+
+        bool is_library() const {
+            return this->library;
+        }
+
+        // Nodes obtained from the filesystem may only be used while holding this lock,
+        // as evicting containers mutates the tree
+        std::shared_lock<std::shared_mutex> lock_tree() const {
+            return std::shared_lock(this->tree_lock);
+        }
+
+        // Collapses the least recently used containers until the tree fits the budget
+        // (count of loaded top-level containers of a library, host files open, and estimated memory)
+        // Must not be called while holding the tree lock
+        void trim();
+
         std::optional<std::shared_ptr<Folder>> process_dir(const std::filesystem::path &path);
 
         static inline std::string &&normalize_path(std::string &&path) {
@@ -165,13 +239,108 @@ class FileSystem {
 
         std::optional<std::shared_ptr<Folder>> find_folder(const std::filesystem::path &path);
 
+        // Visits the subtree at location depth-first, with the folders of a directory before its files
+        // Visitors are called with the path of the node, only valid for the duration of the call, the node itself,
+        // and optionally the folder containing it, and return true to stop the walk
+        template <typename FolderVisitor, typename FileVisitor>
         bool walk(const std::filesystem::path &location, std::size_t depth,
-            const std::function<bool(const std::filesystem::path &)> &callback_folder,
-            const std::function<bool(const std::filesystem::path &)> &callback_file);
+                FolderVisitor &&visit_folder, FileVisitor &&visit_file) {
+            if (!depth)
+                return false;
+
+            auto path = FileSystem::normalize_path(PATHSTR(location));
+            auto opt = this->get_folder(path);
+            if (!opt)
+                return true;
+
+            if (path.ends_with('/'))
+                path.pop_back();
+
+            struct Frame {
+                const Folder *folder;
+                std::size_t   path_len;
+                std::size_t   next_child = 0;
+            };
+
+            auto visit = [&path](auto &visitor, const auto &node, const Folder &parent) -> bool {
+                if constexpr (std::is_invocable_v<decltype(visitor), const std::string &, decltype(node), const Folder &>)
+                    return visitor(std::as_const(path), node, parent);
+                else
+                    return visitor(std::as_const(path), node);
+            };
+
+            std::vector<Frame> stack;
+            stack.reserve(std::min(depth, std::size_t(0x20)));
+            stack.push_back({ opt->get(), path.size() });
+
+            while (!stack.empty()) {
+                auto &frame = stack.back();
+                auto &children = frame.folder->get_children();
+                path.resize(frame.path_len);
+
+                if (frame.next_child < children.size()) {
+                    auto &child = children[frame.next_child++];
+                    path.append(1, '/').append(child->get_name());
+
+                    // Containers are only opened when their contents are going to be visited
+                    bool descend = stack.size() < depth;
+                    if (descend)
+                        this->expand(path, child);
+
+                    if (visit(visit_folder, child, *frame.folder))
+                        return true;
+                    if (descend)
+                        stack.push_back({ child.get(), path.size() });
+                    continue;
+                }
+
+                for (auto &file: frame.folder->get_files()) {
+                    path.resize(frame.path_len);
+                    path.append(1, '/').append(file->get_name());
+                    if (visit(visit_file, file, *frame.folder))
+                        return true;
+                }
+
+                stack.pop_back();
+            }
+
+            return false;
+        }
+
+    private:
+        void expand(const std::string &path, const std::shared_ptr<Folder> &dir);
+        void touch(const std::string &path);
+        void promote(const std::string &path);
+        void collapse(const std::string &path, const std::shared_ptr<Folder> &folder);
+        void untrack(const std::string &path);
+
+        bool is_tracking() const {
+            return this->library || (this->max_memory != static_cast<std::size_t>(-1));
+        }
 
     private:
+        // Positions in the eviction orders, from coldest to hottest
+        using LruList = std::list<std::string>;
+
+        struct LoadedContainer {
+            std::shared_ptr<Folder> folder;
+            std::size_t             footprint;
+            bool                    is_top;
+            LruList::iterator       lru_it, top_it;
+        };
+
         File base;
         bool keep_raw;
+
+        bool        library    = false;
+        std::size_t max_loaded = -1, max_memory = -1, max_files = -1;
+        mutable std::mutex loaded_mtx;
+        std::size_t        loaded_top    = 0;
+        std::size_t        loaded_memory = 0;
+        std::unordered_map<std::string, LoadedContainer> loaded;
+        LruList            lru, lru_top;
+
+        mutable std::shared_mutex tree_lock;
         mutable std::shared_mutex files_lock, folders_lock;
         std::unordered_map<std::string, std::shared_ptr<File>>   files;
         std::unordered_map<std::string, std::shared_ptr<Folder>> folders;
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 averne
+#
+# This file is part of fuse-nx.
+#
+# fuse-nx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# fuse-nx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+# Run with the fnxbinds extension importable, eg. after `pip install .`
+
+import os, io, sys, tempfile, unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'bindings'))
+import fnx.hac as hac
+
+
+DATA = bytes(range(256)) * 16
+
+
+class TestFilePosition(unittest.TestCase):
+    def test_consecutive_reads(self):
+        f = hac.File(io.BytesIO(DATA))
+        f.seek(10)
+        self.assertEqual(f.read(20), DATA[10:30])
+        self.assertEqual(f.tell(), 30)
+        self.assertEqual(f.read(5), DATA[30:35])
+        self.assertEqual(f.tell(), 35)
+
+    def test_object_position(self):
+        # Objects without a descriptor are seeked and read, and are left after the data read
+        obj = io.BytesIO(DATA)
+        f = hac.File(obj)
+        f.seek(100)
+        f.read(10)
+        self.assertEqual(obj.tell(), 110)
+
+    def test_descriptor_position(self):
+        # Regular files are read through their descriptor, without moving the object
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, 'data.bin')
+            with open(path, 'wb') as out:
+                out.write(DATA)
+
+            with open(path, 'rb') as obj:
+                obj.seek(3)
+                f = hac.File(obj)
+                f.seek(100)
+                self.assertEqual(f.read(10), DATA[100:110])
+                self.assertEqual(f.tell(), 110)
+                self.assertEqual(obj.tell(), 3)
+
+
+if __name__ == '__main__':
+    unittest.main()
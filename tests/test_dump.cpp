@@ -0,0 +1,193 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fnx.hpp>
+
+#include "dump.hpp"
+#include "vfs.hpp"
+#include "test.hpp"
+
+using namespace fnx;
+namespace fs = std::filesystem;
+
+namespace {
+
+using Tree = std::map<std::string, std::string>; // Path, content
+
+template <typename T>
+void append(std::string &buf, T value) {
+    buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Builds a partition filesystem holding the given files in order
+std::string make_pfs0(const std::vector<std::pair<std::string, std::string>> &files) {
+    std::string names;
+    std::vector<std::uint32_t> name_offsets;
+    for (auto &[name, _]: files) {
+        name_offsets.push_back(names.size());
+        names += name + '\0';
+    }
+    while ((0x10 + 0x18 * files.size() + names.size()) % 0x20)
+        names.push_back('\0');
+
+    std::string buf = "PFS0";
+    append<std::uint32_t>(buf, files.size());
+    append<std::uint32_t>(buf, names.size());
+    append<std::uint32_t>(buf, 0);
+
+    std::uint64_t offset = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        append<std::uint64_t>(buf, offset);
+        append<std::uint64_t>(buf, files[i].second.size());
+        append<std::uint32_t>(buf, name_offsets[i]);
+        append<std::uint32_t>(buf, 0);
+        offset += files[i].second.size();
+    }
+
+    buf += names;
+    for (auto &[_, data]: files)
+        buf += data;
+    return buf;
+}
+
+std::string make_data(std::size_t size, std::uint32_t seed) {
+    std::string data(size, '\0');
+    for (auto &c: data)
+        c = static_cast<char>((seed = seed * 1103515245 + 12345) >> 16);
+    return data;
+}
+
+std::string read_file(const fs::path &path) {
+    std::ifstream is(path, std::ios::binary);
+    return { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+}
+
+Tree read_tree(const fs::path &root) {
+    Tree tree;
+    for (auto &entry: fs::recursive_directory_iterator(root))
+        if (entry.is_regular_file() && (entry.path().filename() != ".fnx-manifest"))
+            tree.emplace('/' + entry.path().lexically_relative(root).generic_string(), read_file(entry.path()));
+    return tree;
+}
+
+// Regular members of a ustar archive, with their content
+Tree read_tar(const std::string &archive) {
+    Tree tree;
+    for (std::size_t pos = 0; pos + 0x200 <= archive.size();) {
+        auto *hdr = archive.data() + pos;
+        if (!hdr[0])
+            break;
+
+        std::string name(hdr, strnlen(hdr, 100));
+        auto size = std::strtoull(std::string(hdr + 124, 12).c_str(), nullptr, 8);
+        if (hdr[156] == '0')
+            tree.emplace('/' + name, archive.substr(pos + 0x200, size));
+        pos += 0x200 + (size + 0x1ff) / 0x200 * 0x200;
+    }
+    return tree;
+}
+
+// Files the dumps should produce, as listed by walking the tree with raw containers kept
+Tree walk_tree(const fs::path &container) {
+    FileSystem filesys(container);
+    filesys.set_keep_raw(true);
+    filesys.find_folder("/");
+
+    Tree tree;
+    filesys.walk("/", -1, [](auto &&...) { return false; }, [&tree](const std::string &path, const std::shared_ptr<File> &file) {
+        std::string data(file->get_size(), '\0');
+        file->open()->read_at(0, reinterpret_cast<std::uint8_t *>(data.data()), data.size());
+        tree.emplace(path, std::move(data));
+        return false;
+    });
+    return tree;
+}
+
+void test_raw_containers(const fs::path &dir) {
+    auto inner = make_pfs0({
+        { "c.txt", "hello c\n" },
+        { "d.bin", make_data(100000, 2) },
+    });
+    auto outer = make_pfs0({
+        { "a.txt",     "hello a\n" },
+        { "big.bin",   make_data(300000, 1) },
+        { "inner.nsp", inner },
+        { "empty.bin", "" },
+        { "zero.bin",  std::string(0x20000, '\0') },
+    });
+
+    auto container = dir / "test.nsp";
+    std::ofstream(container, std::ios::binary) << outer;
+
+    auto expected = walk_tree(container);
+    FNX_CHECK(expected.contains("/inner.nsp"));
+    FNX_CHECK(expected.contains("/inner/c.txt"));
+    FNX_CHECK(expected.size() == 7);
+
+    auto dump_to = [&container](const fs::path &dest, bool linear) {
+        fs::create_directories(dest);
+        DumpContext::Options options;
+        options.jobs   = 2;
+        options.linear = linear;
+        options.paths  = { "/" };
+        return DumpContext(container, dest).run(options);
+    };
+
+    FNX_CHECK(dump_to(dir / "normal", false) == 0);
+    FNX_CHECK(dump_to(dir / "linear", true)  == 0);
+    FNX_CHECK(read_tree(dir / "normal") == expected);
+    FNX_CHECK(read_tree(dir / "linear") == expected);
+
+    // The archive is streamed to the standard output
+    auto archive = dir / "test.tar";
+    FNX_CHECK(std::freopen(PATHSTR(archive).c_str(), "wb", stdout));
+    DumpContext::Options options;
+    options.format = "tar";
+    options.paths  = { "/" };
+    FNX_CHECK(DumpContext(container, "-").run(options) == 0);
+    std::fclose(stdout);
+    FNX_CHECK(read_tar(read_file(archive)) == expected);
+}
+
+} // namespace
+
+int main() {
+    crypt::KeySet::set(std::make_unique<crypt::KeySet>());
+    crypt::TitlekeySet::set(std::make_unique<crypt::TitlekeySet>());
+
+    auto dir = fs::temp_directory_path() / "fnx-test-dump";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    test_raw_containers(dir);
+
+    fs::remove_all(dir);
+    return test::report();
+}
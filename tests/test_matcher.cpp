@@ -0,0 +1,103 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "matcher.hpp"
+#include "test.hpp"
+
+using namespace fnx;
+
+namespace {
+
+bool glob_matches(const std::string &glob, const std::string &name) {
+    NameFilter filter({ glob }, false, false);
+    if (!filter.get_error().empty()) {
+        std::fprintf(stderr, "%s\n", filter.get_error().c_str());
+        return false;
+    }
+    return filter.matches(name);
+}
+
+#define CHECK_GLOB(glob, name, expected) do {                                       \
+    if (glob_matches(glob, name) != expected)                                       \
+        std::fprintf(stderr, "glob \"%s\" (regex \"%s\") on \"%s\"\n",              \
+            glob, NameFilter::glob_to_regex(glob).c_str(), name);                   \
+    FNX_CHECK(glob_matches(glob, name) == expected);                                \
+} while (0)
+
+void test_wildcards() {
+    CHECK_GLOB("*.nca",  "a.nca",   true);
+    CHECK_GLOB("*.nca",  "a.ncz",   false);
+    CHECK_GLOB("?.nca",  "ab.nca",  false);
+    CHECK_GLOB("a+b(c)", "a+b(c)",  true);
+    CHECK_GLOB("a\\*",   "a*",      true);
+    CHECK_GLOB("a\\*",   "ab",      false);
+    CHECK_GLOB("[ab",    "[ab",     true);
+}
+
+void test_classes() {
+    CHECK_GLOB("[[:alpha:]]x",          "ax", true);
+    CHECK_GLOB("[[:alpha:]]x",          "1x", false);
+    CHECK_GLOB("[![:alpha:]]x",         "1x", true);
+    CHECK_GLOB("[[:digit:][:upper:]]",  "5",  true);
+    CHECK_GLOB("[[:digit:][:upper:]]",  "Q",  true);
+    CHECK_GLOB("[[:digit:][:upper:]]",  "q",  false);
+    CHECK_GLOB("[a[:digit:]-]",         "-",  true);
+}
+
+void test_set_specials() {
+    // Closing bracket first in the set
+    CHECK_GLOB("[]a]",   "]",  true);
+    CHECK_GLOB("[]a]",   "a",  true);
+    CHECK_GLOB("[!]]",   "]",  false);
+    CHECK_GLOB("[!]]",   "b",  true);
+
+    // Escapes inside the set
+    CHECK_GLOB("[\\]]",  "]",  true);
+    CHECK_GLOB("[a\\b]", "b",  true);
+    CHECK_GLOB("[a\\b]", "\\", false);
+    CHECK_GLOB("[\\\\]", "\\", true);
+    CHECK_GLOB("[a\\-z]", "-", true);
+    CHECK_GLOB("[a\\-z]", "m", false);
+
+    // Regex metacharacters are literal
+    CHECK_GLOB("[[]",    "[",  true);
+    CHECK_GLOB("[.^$]",  "^",  true);
+    CHECK_GLOB("[.^$]",  "$",  true);
+    CHECK_GLOB("[.^$]",  "x",  false);
+    CHECK_GLOB("[^.]",   ".",  false);
+
+    // Ranges, including between punctuation
+    CHECK_GLOB("[a-c]",  "b",  true);
+    CHECK_GLOB("[!a-c]", "b",  false);
+    CHECK_GLOB("[#-/]",  "+",  true);
+    CHECK_GLOB("[#-/]",  "0",  false);
+}
+
+} // namespace
+
+int main() {
+    test_wildcards();
+    test_classes();
+    test_set_specials();
+
+    return fnx::test::report();
+}
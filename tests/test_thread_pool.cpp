@@ -0,0 +1,122 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of fuse-nx.
+//
+// fuse-nx is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// fuse-nx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with fuse-nx.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string_view>
+
+#include "thread_pool.hpp"
+#include "test.hpp"
+
+using namespace fnx;
+
+namespace {
+
+void test_nested_count() {
+    std::atomic_size_t count = 0;
+
+    TaskGroup outer;
+    for (int i = 0; i < 16; ++i) {
+        outer.run([&count] {
+            TaskGroup inner;
+            for (int j = 0; j < 16; ++j)
+                inner.run([&count] { ++count; });
+            inner.wait();
+        });
+    }
+    outer.wait();
+
+    FNX_CHECK(count == 16 * 16);
+}
+
+void test_nested_throw() {
+    std::atomic_size_t count = 0;
+    bool caught = false;
+
+    TaskGroup outer;
+    for (int i = 0; i < 8; ++i) {
+        outer.run([&count, i] {
+            TaskGroup inner;
+            for (int j = 0; j < 8; ++j) {
+                inner.run([&count, i, j] {
+                    if ((i == 3) && (j == 5))
+                        throw std::runtime_error("task failed");
+                    ++count;
+                });
+            }
+            inner.wait();
+        });
+    }
+
+    try {
+        outer.wait();
+    } catch (const std::runtime_error &e) {
+        caught = std::string_view(e.what()) == "task failed";
+    }
+
+    // Every other task still ran, and the group can be reused
+    FNX_CHECK(caught);
+    FNX_CHECK(count == 8 * 8 - 1);
+
+    outer.run([&count] { ++count; });
+    outer.wait();
+    FNX_CHECK(count == 8 * 8);
+}
+
+void test_parallel_for_throw() {
+    std::atomic_size_t count = 0;
+    bool caught = false;
+
+    try {
+        parallel_for(100, [&count](std::size_t i) {
+            if (i == 42)
+                throw std::runtime_error("index failed");
+            ++count;
+        });
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+
+    FNX_CHECK(caught);
+}
+
+void test_dropped_throw() {
+    // Not waited on, the exception is dropped by the destructor instead of hanging or terminating
+    {
+        TaskGroup group;
+        group.run([] { throw std::runtime_error("ignored"); });
+    }
+
+    TaskGroup group;
+    group.run([] { });
+    group.wait();
+    FNX_CHECK(true);
+}
+
+} // namespace
+
+int main() {
+    set_scheduler_workers(4);
+
+    test_nested_count();
+    test_nested_throw();
+    test_parallel_for_throw();
+    test_dropped_throw();
+
+    return fnx::test::report();
+}